@@ -0,0 +1,192 @@
+/*
+    bench_handoff.c - 작업 넘겨주기(hand-off) 벤치마크
+
+    accept thread -> worker thread 로 connection 을 넘기는 부분만 떼어내서 비교함.
+      mutex : 예전 proxy_cache.c 의 큐 (MAXQUEUE 100, mutex + condition variable 2개)
+      ring  : ring.c 의 lock-free MPMC ring (비었을 때만 futex 에서 잠듦)
+
+    원소는 connection 정보와 같은 크기에 넣은 시각을 담아서, 꺼낸 쪽에서 대기 시간을 잼.
+
+    usage: bench_handoff [-q mutex|ring] [-p producers] [-c consumers] [-n items]
+*/
+#include <time.h>
+#include "csapp.h"
+#include "ring.h"
+
+#define MAXQUEUE 100
+
+typedef struct
+{
+  long long enq_ns; // 넣은 시각. 0 이면 consumer 종료 신호
+  int connfd;
+  socklen_t clientlen;
+  struct sockaddr_storage clientaddr;
+} item_t;
+
+/* 예전 proxy_cache.c 의 큐 그대로 */
+static item_t queue[MAXQUEUE];
+static int queue_head = 0, queue_tail = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+
+static ring_t ring;
+
+static int use_ring = 1;
+static long items_per_producer;
+
+typedef struct
+{
+  pthread_t tid;
+  long count;
+  long long *lat; // consumer 가 기록한 대기 시간 (ns)
+} bench_thread_t;
+
+static long long now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void put(item_t *it)
+{
+  if (use_ring)
+  {
+    while (ring_push(&ring, it) < 0)
+      sched_yield();
+    return;
+  }
+  pthread_mutex_lock(&queue_mutex);
+  while ((queue_tail + 1) % MAXQUEUE == queue_head)
+    pthread_cond_wait(&queue_not_full, &queue_mutex);
+  queue[queue_tail] = *it;
+  queue_tail = (queue_tail + 1) % MAXQUEUE;
+  pthread_cond_signal(&queue_not_empty);
+  pthread_mutex_unlock(&queue_mutex);
+}
+
+static void get(item_t *it)
+{
+  if (use_ring)
+  {
+    ring_pop_wait(&ring, it);
+    return;
+  }
+  pthread_mutex_lock(&queue_mutex);
+  while (queue_head == queue_tail)
+    pthread_cond_wait(&queue_not_empty, &queue_mutex);
+  *it = queue[queue_head];
+  queue_head = (queue_head + 1) % MAXQUEUE;
+  pthread_cond_signal(&queue_not_full);
+  pthread_mutex_unlock(&queue_mutex);
+}
+
+static void *producer(void *arg)
+{
+  item_t it;
+
+  memset(&it, 0, sizeof(it));
+  for (long i = 0; i < items_per_producer; i++)
+  {
+    it.connfd = (int)i;
+    it.enq_ns = now_ns();
+    put(&it);
+  }
+  return NULL;
+}
+
+static void *consumer(void *arg)
+{
+  bench_thread_t *t = arg;
+  item_t it;
+
+  while (1)
+  {
+    get(&it);
+    if (it.enq_ns == 0)
+      break;
+    t->lat[t->count++] = now_ns() - it.enq_ns;
+  }
+  return NULL;
+}
+
+static int cmp_ll(const void *a, const void *b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+  return x < y ? -1 : x > y;
+}
+
+int main(int argc, char **argv)
+{
+  int nproducers = 1, nconsumers = 4, opt;
+  long nitems = 1000000;
+
+  while ((opt = getopt(argc, argv, "q:p:c:n:")) != -1)
+  {
+    switch (opt)
+    {
+    case 'q':
+      if (!strcmp(optarg, "mutex"))
+        use_ring = 0;
+      else if (strcmp(optarg, "ring"))
+        app_error("-q 는 mutex 또는 ring");
+      break;
+    case 'p':
+      nproducers = atoi(optarg);
+      break;
+    case 'c':
+      nconsumers = atoi(optarg);
+      break;
+    case 'n':
+      nitems = atol(optarg);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-q mutex|ring] [-p producers] [-c consumers] [-n items]\n", argv[0]);
+      exit(1);
+    }
+  }
+  if (nproducers < 1 || nconsumers < 1 || nitems < nproducers)
+    app_error("producer, consumer, item 수는 1 이상이어야 함");
+
+  items_per_producer = nitems / nproducers;
+  nitems = items_per_producer * nproducers;
+  ring_init(&ring, 1024, sizeof(item_t));
+
+  bench_thread_t *prod = Calloc(nproducers, sizeof(bench_thread_t));
+  bench_thread_t *cons = Calloc(nconsumers, sizeof(bench_thread_t));
+  for (int i = 0; i < nconsumers; i++)
+  {
+    cons[i].lat = Malloc(nitems * sizeof(long long)); // 한 consumer 가 전부 가져갈 수도 있음
+    Pthread_create(&cons[i].tid, NULL, consumer, &cons[i]);
+  }
+
+  long long start = now_ns();
+  for (int i = 0; i < nproducers; i++)
+    Pthread_create(&prod[i].tid, NULL, producer, &prod[i]);
+  for (int i = 0; i < nproducers; i++)
+    Pthread_join(prod[i].tid, NULL);
+
+  item_t stop;
+  memset(&stop, 0, sizeof(stop));
+  for (int i = 0; i < nconsumers; i++)
+    put(&stop);
+  for (int i = 0; i < nconsumers; i++)
+    Pthread_join(cons[i].tid, NULL);
+  long long elapsed = now_ns() - start;
+
+  /* consumer 별 기록을 하나로 모아서 백분위 계산 */
+  long long *all = Malloc(nitems * sizeof(long long));
+  long n = 0;
+  for (int i = 0; i < nconsumers; i++)
+  {
+    memcpy(all + n, cons[i].lat, cons[i].count * sizeof(long long));
+    n += cons[i].count;
+  }
+  qsort(all, n, sizeof(long long), cmp_ll);
+
+  printf("%-5s producers=%d consumers=%d items=%ld  %.0f items/s  p50=%lldns p99=%lldns\n",
+         use_ring ? "ring" : "mutex", nproducers, nconsumers, n,
+         n / (elapsed / 1e9), all[n / 2], all[(long)(n * 0.99)]);
+  return 0;
+}
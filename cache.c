@@ -0,0 +1,1296 @@
+/*
+    cache.c - 웹 서버 응답 캐시 (shard 별 hash index + 교체 가능한 소거 정책, lock 없는 조회, 참조 카운트 전송, segment 로 바로 받는 캐싱)
+*/
+#include <sys/uio.h>
+#include "cache.h"
+#include "epoch.h"
+#include "freshness.h"
+#include "log.h"
+
+static inline cache_block *block_at(cache_shard_t *shard, int index)
+{
+  cache_block *chunk = atomic_load_explicit(&shard->chunks[index / CACHE_CHUNK], memory_order_acquire);
+  return &chunk[index % CACHE_CHUNK];
+}
+
+static inline tw_timer_t *expiry_at(cache_shard_t *shard, int index)
+{
+  return &shard->expiry_chunks[index / CACHE_CHUNK][index % CACHE_CHUNK].timer;
+}
+
+/* index 재배치 때 cache block 번호로 hash 를 다시 얻음 (writer 만 호출) */
+static uint64_t block_hash(int32_t index, void *arg)
+{
+  return atomic_load_explicit(&block_at(arg, index)->entry, memory_order_relaxed)->hash;
+}
+
+typedef struct
+{
+  uint64_t hash;
+  const char *uri;
+  cache_entry_t *found; // 일치한 entry. 비교한 것과 같은 entry 를 돌려주려고 여기에 남김
+} cache_key_t;
+
+/* index 가 tag 가 같은 후보를 줄 때만 호출됨. hash 가 다르면 strcmp 까지 가지 않음 */
+static int block_eq(int32_t index, const void *key, void *arg)
+{
+  cache_key_t *k = (cache_key_t *)key;
+  cache_entry_t *e = atomic_load_explicit(&block_at(arg, index)->entry, memory_order_acquire);
+
+  if (e == NULL || e->hash != k->hash || strcmp(e->uri, k->uri))
+    return 0;
+  k->found = e;
+  return 1;
+}
+
+/* 일치하는 cache block 번호, 없으면 -1. reader 는 epoch 안에서 호출 */
+static int find_hashed(cache_shard_t *shard, cache_key_t *key)
+{
+  key->found = NULL;
+  return hindex_find(&shard->index, key->hash, block_eq, key);
+}
+
+static void retire_table(void *table)
+{
+  epoch_retire(table, NULL);
+}
+
+/* 소거 정책 (policy.h). 빌드할 때 CACHE_POLICY 로 정했으면 함수 표를 거치지 않고 그 정책의 함수를 직접 부름 */
+#define POLICY_CAT_(a, b) a##_##b
+#define POLICY_CAT(a, b) POLICY_CAT_(a, b)
+#define POLICY_STR_(a) #a
+#define POLICY_STR(a) POLICY_STR_(a)
+#ifdef CACHE_POLICY
+#define POLICY_OP(shard, op) POLICY_CAT(CACHE_POLICY, op)
+static const cache_policy_t *cache_policy = &POLICY_CAT(policy, CACHE_POLICY);
+#else
+#define POLICY_OP(shard, op) (shard)->policy->op
+static const cache_policy_t *cache_policy = &policy_wtinylfu;
+#endif
+
+int cache_set_policy(const char *name)
+{
+#ifdef CACHE_POLICY
+  return strcmp(name, POLICY_STR(CACHE_POLICY)) ? -1 : 0;
+#else
+  const cache_policy_t *p = policy_find(name);
+
+  if (p == NULL)
+    return -1;
+  cache_policy = p;
+  return 0;
+#endif
+}
+
+const char *cache_policy_name(void)
+{
+  return cache_policy->name;
+}
+
+static void shard_init(cache_shard_t *shard, size_t max_bytes)
+{
+  pthread_mutex_init(&shard->lock, NULL);
+  for (int i = 0; i < CACHE_MAX_CHUNKS; i++)
+  {
+    atomic_init(&shard->chunks[i], NULL);
+    shard->expiry_chunks[i] = NULL;
+  }
+  shard->nblocks = 0;
+  shard->nused = 0;
+  shard->free_blocks = NULL;
+  shard->nfree = 0;
+  shard->max_bytes = max_bytes;
+  shard->used_bytes = 0;
+  hindex_init(&shard->index, CACHE_CHUNK, block_hash, shard);
+  shard->index.retire = retire_table;
+  shard->flights = NULL;
+
+  shard->policy = cache_policy;
+  shard->policy_state = POLICY_OP(shard, create)(max_bytes);
+  tw_init(&shard->expiry, CACHE_EXPIRE_TICK_MS);
+}
+
+/* 만료 처리 thread. cache_init 한 캐시들의 shard 를 CACHE_EXPIRE_TICK_MS 마다 돌면서 신선한 기간이 지난 응답을 소거 */
+static pthread_mutex_t expire_lock = PTHREAD_MUTEX_INITIALIZER;
+static Cache **expire_caches;
+static int expire_ncaches;
+static void *demote_thread(void *arg);
+
+static void *expire_thread(void *arg)
+{
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    usleep(CACHE_EXPIRE_TICK_MS * 1000);
+    pthread_mutex_lock(&expire_lock);
+    for (int i = 0; i < expire_ncaches; i++)
+      for (int j = 0; j < expire_caches[i]->nshards; j++)
+      {
+        cache_shard_t *shard = &expire_caches[i]->shards[j];
+
+        pthread_mutex_lock(&shard->lock);
+        tw_advance(&shard->expiry, tw_now_ms());
+        pthread_mutex_unlock(&shard->lock);
+      }
+    pthread_mutex_unlock(&expire_lock);
+  }
+  return NULL;
+}
+
+/* 캐시 초기화 함수. 캐시 byte 한도를 shard 들이 똑같이 나눠 가짐 */
+void cache_init(Cache *cache, size_t max_bytes, int nshards)
+{
+  /* shard 하나에 가장 큰 응답 하나는 들어가도록 shard 수를 줄임. 빠른 선택을 위해 2의 거듭제곱으로 */
+  while (nshards > 1 && max_bytes / nshards < MAX_OBJECT_SIZE)
+    nshards--;
+  while (nshards & (nshards - 1))
+    nshards &= nshards - 1;
+
+  if (posix_memalign((void **)&cache->shards, CACHE_CACHELINE, nshards * sizeof(cache_shard_t)) != 0)
+    unix_error("cache_init error");
+  cache->nshards = nshards;
+  for (int i = 0; i < nshards; i++)
+    shard_init(&cache->shards[i], max_bytes / nshards);
+
+  pthread_mutex_lock(&expire_lock);
+  expire_caches = Realloc(expire_caches, (expire_ncaches + 1) * sizeof(Cache *));
+  expire_caches[expire_ncaches++] = cache;
+  if (expire_ncaches == 1)
+  {
+    pthread_t tid;
+    Pthread_create(&tid, NULL, expire_thread, NULL);
+    if (disk_enabled())
+      Pthread_create(&tid, NULL, demote_thread, NULL);
+  }
+  pthread_mutex_unlock(&expire_lock);
+}
+
+/* uri hash 의 상위 bit 로 shard 선택 (하위 bit 는 hash index 가 씀) */
+static inline cache_shard_t *shard_of(Cache *cache, uint64_t hash)
+{
+  return &cache->shards[(hash >> 32) & (cache->nshards - 1)];
+}
+
+static cache_seg_t *seg_alloc(void)
+{
+  cache_seg_t *s = Malloc(sizeof(cache_seg_t) + CACHE_SEG_SIZE);
+
+  atomic_init(&s->refcnt, 1);
+  s->next = NULL;
+  s->len = 0;
+  return s;
+}
+
+/* segment 참조 하나를 놓음. 마지막 참조였으면 그 segment 가 가진 next 의 참조도 이어서 놓음 */
+static void seg_release(cache_seg_t *s)
+{
+  while (s != NULL && atomic_fetch_sub_explicit(&s->refcnt, 1, memory_order_acq_rel) == 1)
+  {
+    cache_seg_t *next = s->next;
+    free(s);
+    s = next;
+  }
+}
+
+void cache_release(cache_entry_t *e)
+{
+  if (atomic_fetch_sub_explicit(&e->refcnt, 1, memory_order_acq_rel) == 1)
+  {
+    seg_release(e->body);
+    free(e);
+  }
+}
+
+/* 교체 / 소거된 entry. 읽던 thread 가 다 빠져나간 뒤 캐시의 참조를 놓음 */
+static void entry_retired(void *e)
+{
+  cache_release(e);
+}
+
+#define CACHE_IOV_MAX (MAX_OBJECT_SIZE / CACHE_SEG_SIZE + 3) // 헤더 + 본문 segment 들 (시작 위치가 어긋나도 들어가도록)
+
+/* e 의 sent 번째 byte 부터 끝까지를 가리키는 iovec (헤더, 본문 segment 들). 개수를 돌려줌 */
+static int entry_iov(cache_entry_t *e, size_t sent, struct iovec *iov)
+{
+  cache_seg_t *s = e->body;
+  size_t off = e->body_off;
+  int n = 0;
+
+  if (sent < e->hdr_len)
+  {
+    iov[n].iov_base = e->hdr + sent;
+    iov[n++].iov_len = e->hdr_len - sent;
+    sent = 0;
+  }
+  else
+    sent -= e->hdr_len;
+  /* 이미 보낸 segment 는 건너뛰고 나머지 segment 를 그대로 iovec 으로 */
+  for (; s != NULL && n < CACHE_IOV_MAX; s = s->next, off = 0)
+  {
+    if (sent >= s->len - off)
+    {
+      sent -= s->len - off;
+      continue;
+    }
+    iov[n].iov_base = s->data + off + sent;
+    iov[n++].iov_len = s->len - off - sent;
+    sent = 0;
+  }
+  return n;
+}
+
+ssize_t cache_entry_send(cache_entry_t *e, int fd, size_t sent, int flags)
+{
+  struct iovec iov[CACHE_IOV_MAX];
+  struct msghdr msg;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = entry_iov(e, sent, iov);
+  return sendmsg(fd, &msg, flags | MSG_NOSIGNAL);
+}
+
+/* 디스크로 내릴 응답 (참조 하나씩). 소거하는 쪽은 shard->lock 안에서 넣기만 하고 디스크 thread 가 씀 */
+typedef struct
+{
+  cache_entry_t *e;
+  long long ttl_ms; // 넣을 때 남아 있던 신선한 기간
+} cache_demote_t;
+
+static pthread_mutex_t demote_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t demote_cond = PTHREAD_COND_INITIALIZER;
+static cache_demote_t demote_queue[CACHE_DEMOTE_MAX];
+static int demote_head, demote_len;
+
+static void *demote_thread(void *arg)
+{
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    struct iovec iov[CACHE_IOV_MAX];
+    cache_demote_t d;
+
+    pthread_mutex_lock(&demote_lock);
+    while (demote_len == 0)
+      pthread_cond_wait(&demote_cond, &demote_lock);
+    d = demote_queue[demote_head];
+    demote_head = (demote_head + 1) % CACHE_DEMOTE_MAX;
+    demote_len--;
+    pthread_mutex_unlock(&demote_lock);
+
+    disk_put(d.e->hash, d.e->uri, iov, entry_iov(d.e, 0, iov), CACHE_ENTRY_LEN(d.e), d.ttl_ms);
+    cache_release(d.e);
+  }
+  return NULL;
+}
+
+static void record_read(cache_shard_t *shard, int index, cache_entry_t *e);
+static void refresh_push(cache_shard_t *shard, cache_entry_t *e);
+
+int cache_send(Cache *cache, char *uri, int fd, cache_entry_t **hit, size_t *sent)
+{
+  cache_key_t key = {hindex_hash(uri), uri, NULL};
+  cache_shard_t *shard = shard_of(cache, key.hash);
+  cache_entry_t *e;
+  ssize_t n;
+  int index, rc = 0;
+
+  epoch_enter();
+  if ((index = find_hashed(shard, &key)) == -1)
+  {
+    epoch_exit();
+    return -1;
+  }
+  e = key.found;
+  switch (atomic_load_explicit(&e->state, memory_order_relaxed))
+  {
+  case CACHE_REVALIDATE: // miss 로 (cache_fill_start 에서 leader 가 재검증)
+    epoch_exit();
+    return -1;
+  case CACHE_STALE: // stale-while-revalidate. 그대로 보내고 갱신은 뒤에서
+    refresh_push(shard, e);
+    break;
+  }
+  record_read(shard, index, e);
+
+  /* socket buffer 에 들어가는 만큼 바로 보냄. 보통은 여기서 끝나고 공유 메모리에 아무것도 쓰지 않음 */
+  for (*sent = 0; *sent < CACHE_ENTRY_LEN(e); *sent += n)
+  {
+    while ((n = cache_entry_send(e, fd, *sent, MSG_DONTWAIT)) < 0 && errno == EINTR)
+      ;
+    if (n < 0)
+      break;
+  }
+  /* 클라이언트가 느림. 참조를 잡고 나머지는 epoch 밖에서 보내게 함
+     (epoch 안이므로 캐시의 참조가 아직 남아 있어서 0 에서 늘리는 일은 없음) */
+  if (*sent < CACHE_ENTRY_LEN(e) && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+    atomic_fetch_add_explicit(&e->refcnt, 1, memory_order_relaxed);
+    *hit = e;
+    rc = 1;
+  }
+  epoch_exit();
+  log_hit("cache", uri);
+  return rc;
+}
+
+/* cache block 을 비우고 entry 를 회수 예약. shard->lock 을 잡은 상태에서 호출 */
+static void cache_remove(cache_shard_t *shard, int index)
+{
+  cache_block *block = block_at(shard, index);
+  cache_entry_t *e = atomic_load_explicit(&block->entry, memory_order_relaxed);
+
+  POLICY_OP(shard, remove)(shard->policy_state, index);
+  tw_del(&shard->expiry, expiry_at(shard, index));
+  hindex_erase(&shard->index, e->hash, index);
+  atomic_store_explicit(&block->entry, NULL, memory_order_release);
+  shard->used_bytes -= e->bytes;
+  shard->free_blocks[shard->nfree++] = index;
+  epoch_retire(e, entry_retired); // 아직 읽고 있는 thread 가 있을 수 있음
+}
+
+/* byte 한도 때문에 소거. 디스크 tier 가 있으면 아직 신선한 응답은 디스크 thread 에 넘김. shard->lock 을 잡은 상태에서 호출 */
+static void cache_demote(cache_shard_t *shard, int index)
+{
+  cache_entry_t *e = atomic_load_explicit(&block_at(shard, index)->entry, memory_order_relaxed);
+  long long ttl_ms = e->expires_ms - tw_now_ms();
+
+  if (disk_enabled() && ttl_ms >= CACHE_DEMOTE_MIN_TTL_MS &&
+      atomic_load_explicit(&e->state, memory_order_relaxed) == CACHE_FRESH && !disk_live(e->disk_rec))
+  {
+    pthread_mutex_lock(&demote_lock);
+    if (demote_len < CACHE_DEMOTE_MAX) // 디스크가 못 따라오면 버림
+    {
+      atomic_fetch_add_explicit(&e->refcnt, 1, memory_order_relaxed);
+      demote_queue[(demote_head + demote_len++) % CACHE_DEMOTE_MAX] = (cache_demote_t){e, ttl_ms};
+      pthread_cond_signal(&demote_cond);
+    }
+    pthread_mutex_unlock(&demote_lock);
+  }
+  cache_remove(shard, index);
+}
+
+/* 미리 갱신할 시점, 만료 시각, stale-while-revalidate / stale-if-error 기간이 끝나는 시각. 만료 처리 thread 가 shard->lock 을 잡고 부름.
+   다 지난 응답도 validator 가 있으면 조건부 요청으로 재검증할 수 있으므로 소거하지 않고 재검증할 응답으로 표시만 함 */
+static void entry_timer(tw_timer_t *t, void *arg)
+{
+  cache_shard_t *shard = arg;
+  cache_expiry_t *x = (cache_expiry_t *)t;
+  cache_entry_t *e = atomic_load_explicit(&block_at(shard, x->index)->entry, memory_order_relaxed);
+  long long now = tw_now_ms();
+  long long swr_end = e->expires_ms + e->swr * 1000LL, sie_end = e->expires_ms + e->sie * 1000LL;
+  size_t len;
+
+  if (now < e->expires_ms) // 미리 갱신할 시점. 그동안 인기 있었던 응답만
+  {
+    if (x->hits >= CACHE_REFRESH_HITS)
+      refresh_push(shard, e);
+    tw_add(&shard->expiry, t, e->expires_ms);
+  }
+  else if (now < swr_end)
+  {
+    atomic_store_explicit(&e->state, CACHE_STALE, memory_order_relaxed);
+    tw_add(&shard->expiry, t, swr_end);
+  }
+  else if (now < sie_end) // 웹 서버가 실패하면 대신 보낼 수 있으므로 남겨 둠
+  {
+    atomic_store_explicit(&e->state, CACHE_REVALIDATE, memory_order_relaxed);
+    tw_add(&shard->expiry, t, sie_end);
+  }
+  else if (http_field(e->hdr, e->hdr_len, "ETag", &len) == NULL && http_field(e->hdr, e->hdr_len, "Last-Modified", &len) == NULL)
+    cache_remove(shard, x->index);
+  else
+    atomic_store_explicit(&e->state, CACHE_REVALIDATE, memory_order_relaxed);
+}
+
+/* 백그라운드 갱신 요청. 만료 처리 thread (미리 갱신) 와 hit 경로 (stale-while-revalidate) 가 넣고 cache_refresh_next 가 꺼냄 */
+typedef struct cache_refresh
+{
+  cache_shard_t *shard;
+  char *uri;
+  struct cache_refresh *next;
+} cache_refresh_t;
+
+static pthread_mutex_t refresh_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t refresh_cond = PTHREAD_COND_INITIALIZER;
+static cache_refresh_t *refresh_head, **refresh_tail = &refresh_head;
+static int refresh_len;
+
+/* e 의 갱신을 요청. 이미 요청했거나 받아 오는 중이면 아무 일 없음 (e->refreshing 은 갱신한 leader 가 끝날 때 풀림) */
+static void refresh_push(cache_shard_t *shard, cache_entry_t *e)
+{
+  cache_refresh_t *r;
+
+  if (atomic_load_explicit(&e->refreshing, memory_order_relaxed) ||
+      atomic_exchange_explicit(&e->refreshing, 1, memory_order_relaxed))
+    return;
+  r = Malloc(sizeof(cache_refresh_t));
+  r->shard = shard;
+  r->uri = strdup(e->uri);
+  r->next = NULL;
+
+  pthread_mutex_lock(&refresh_lock);
+  if (refresh_len < CACHE_REFRESH_MAX)
+  {
+    *refresh_tail = r;
+    refresh_tail = &r->next;
+    refresh_len++;
+    pthread_cond_signal(&refresh_cond);
+    r = NULL;
+  }
+  pthread_mutex_unlock(&refresh_lock);
+  if (r != NULL) // queue 가 넘침. 다음 hit 이 다시 요청하게 함
+  {
+    atomic_store_explicit(&e->refreshing, 0, memory_order_relaxed);
+    free(r->uri);
+    free(r);
+  }
+}
+
+/* byte 한도 안으로 들어올 때까지 정책이 고른 block 을 소거. shard->lock 을 잡은 상태에서 호출 */
+static void cache_evict(cache_shard_t *shard)
+{
+  int victim;
+
+  while (shard->used_bytes > shard->max_bytes && (victim = POLICY_OP(shard, victim)(shard->policy_state)) >= 0)
+    cache_demote(shard, victim);
+}
+
+/* thread 마다 가진 hit 기록. hit 경로는 여기에만 쓰고, 모이면 shard 별로 lock 을 잡을 수 있을 때 반영 */
+typedef struct
+{
+  cache_shard_t *shard; // 반영했으면 NULL
+  cache_entry_t *e;     // hit 한 entry. 반영할 때 block 이 아직 이 entry 를 가리킬 때만 정책에 알림 (포인터 비교만 함)
+  int index;
+} cache_read_t;
+
+static __thread cache_read_t read_buf[CACHE_READ_BUF];
+static __thread int read_buf_len;
+
+static void drain_reads(void)
+{
+  for (int i = 0; i < read_buf_len; i++)
+  {
+    cache_shard_t *shard = read_buf[i].shard;
+    int locked;
+
+    if (shard == NULL)
+      continue;
+    locked = pthread_mutex_trylock(&shard->lock) == 0; // 캐싱 중이면 기다리지 않고 이 shard 의 기록은 버림
+    for (int j = i; j < read_buf_len; j++)
+    {
+      cache_read_t *r = &read_buf[j];
+      if (r->shard != shard)
+        continue;
+      if (locked && atomic_load_explicit(&block_at(shard, r->index)->entry, memory_order_relaxed) == r->e)
+      {
+        POLICY_OP(shard, hit)(shard->policy_state, r->index);
+        ((cache_expiry_t *)expiry_at(shard, r->index))->hits++;
+      }
+      r->shard = NULL;
+    }
+    if (locked)
+      pthread_mutex_unlock(&shard->lock);
+  }
+  read_buf_len = 0;
+}
+
+static void record_read(cache_shard_t *shard, int index, cache_entry_t *e)
+{
+  cache_read_t *r = &read_buf[read_buf_len++];
+
+  r->shard = shard;
+  r->e = e;
+  r->index = index;
+  if (read_buf_len == CACHE_READ_BUF)
+    drain_reads();
+}
+
+/* 빈 cache block 하나를 꺼냄. 다 쓰였으면 chunk 하나를 더 할당. 더 늘릴 수 없으면 -1 */
+static int cache_alloc_block(cache_shard_t *shard)
+{
+  if (shard->nfree > 0)
+    return shard->free_blocks[--shard->nfree];
+  if (shard->nused == shard->nblocks)
+  {
+    int c = shard->nblocks / CACHE_CHUNK;
+
+    if (c == CACHE_MAX_CHUNKS)
+      return -1;
+    // 이미 있는 chunk 는 옮기지 않으므로 lock 없이 읽는 thread 에게 안전함
+    atomic_store_explicit(&shard->chunks[c], Calloc(CACHE_CHUNK, sizeof(cache_block)), memory_order_release);
+    shard->expiry_chunks[c] = Malloc(CACHE_CHUNK * sizeof(cache_expiry_t));
+    for (int i = 0; i < CACHE_CHUNK; i++)
+    {
+      tw_timer_init(&shard->expiry_chunks[c][i].timer, entry_timer, shard);
+      shard->expiry_chunks[c][i].index = c * CACHE_CHUNK + i;
+    }
+    shard->nblocks += CACHE_CHUNK;
+    shard->free_blocks = Realloc(shard->free_blocks, shard->nblocks * sizeof(int));
+  }
+  return shard->nused++;
+}
+
+/* 응답 헤더 길이 (빈 줄 "\r\n\r\n" 까지). segment 경계에 걸쳐 있어도 찾음. 빈 줄이 아직 없으면 0 */
+static size_t header_length(cache_seg_t *s)
+{
+  static const char end[] = "\r\n\r\n";
+  size_t pos = 0;
+  int matched = 0;
+
+  for (; s != NULL; s = s->next)
+    for (size_t i = 0; i < s->len; i++, pos++)
+    {
+      if (s->data[i] == end[matched])
+        matched++;
+      else
+        matched = s->data[i] == '\r';
+      if (matched == 4)
+        return pos + 1;
+    }
+  return 0;
+}
+
+/* segment 묶음 앞쪽 len byte 를 dst 로 복사 */
+static void seg_copy(cache_seg_t *s, char *dst, size_t len)
+{
+  for (; len > 0; s = s->next)
+  {
+    size_t n = s->len < len ? s->len : len;
+    memcpy(dst, s->data, n);
+    dst += n;
+    len -= n;
+  }
+}
+
+/* 받아 오는 중인 응답 하나. leader 와 follower 가 참조를 하나씩 가짐 */
+struct cache_flight
+{
+  atomic_int refcnt;
+  uint64_t hash;
+  char *uri;
+  cache_shard_t *shard;
+  int linked;                // shard->flights 에 들어 있는지 (shard->lock 으로 보호)
+  struct cache_flight *next; // shard->flights 목록
+
+  /* 아래는 lock 으로 보호 */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;       // thread pool 의 follower 가 기다림
+  cache_seg_t *head;         // 첫 segment (참조 하나). 새 follower 가 여기서부터 읽음. 등록이 풀리면 NULL
+  size_t len;                // follower 가 읽어도 되는 byte 수. 응답 헤더를 보고 공유해도 되는 응답인지 정하기 전에는 0
+  int done;                  // 0 받는 중, 1 끝남, -1 실패
+  int pass;                  // 공유하면 안 되는 응답 (private, no-store 등). follower 는 각자 웹 서버에 요청
+  cache_entry_t *entry;      // 304 로 재검증된 캐시의 응답 (참조 하나). follower 는 받은 byte 대신 이것을 읽음
+  int nfollowers;
+  cache_waiter_t *waiters;   // event loop 의 follower 가 기다림
+};
+
+static void flight_release(cache_flight_t *fl)
+{
+  if (atomic_fetch_sub_explicit(&fl->refcnt, 1, memory_order_acq_rel) != 1)
+    return;
+  pthread_mutex_destroy(&fl->lock);
+  pthread_cond_destroy(&fl->cond);
+  if (fl->entry != NULL)
+    cache_release(fl->entry);
+  free(fl->uri);
+  free(fl);
+}
+
+/* 기다리는 follower 를 모두 깨움. fl->lock 을 잡은 상태에서 호출 */
+static void flight_wake(cache_flight_t *fl)
+{
+  cache_waiter_t *w = fl->waiters;
+
+  if (fl->nfollowers == 0)
+    return;
+  pthread_cond_broadcast(&fl->cond);
+  fl->waiters = NULL;
+  while (w != NULL)
+  {
+    cache_waiter_t *next = w->next;
+    w->waiting = 0;
+    w->wake(w);
+    w = next;
+  }
+}
+
+/* shard->flights 에서 뺌. shard->lock 을 잡은 상태에서 호출 */
+static void flight_unlink(cache_flight_t *fl)
+{
+  cache_flight_t **pp;
+
+  if (!fl->linked)
+    return;
+  for (pp = &fl->shard->flights; *pp != fl; pp = &(*pp)->next)
+    ;
+  *pp = fl->next;
+  fl->linked = 0;
+}
+
+/* 더 이상 follower 가 붙지 않게 하고 첫 segment 의 참조를 놓음. 이미 붙은 follower 는 자기 위치의 참조로 계속 읽음 */
+static void flight_unregister(cache_flight_t *fl)
+{
+  cache_seg_t *head;
+
+  pthread_mutex_lock(&fl->shard->lock);
+  flight_unlink(fl);
+  pthread_mutex_unlock(&fl->shard->lock);
+
+  pthread_mutex_lock(&fl->lock);
+  head = fl->head;
+  fl->head = NULL;
+  pthread_mutex_unlock(&fl->lock);
+  seg_release(head);
+}
+
+/* cache_fill_start, cache_refresh_next 의 공통 부분. fw 가 NULL 이면 백그라운드 갱신:
+   갱신을 요청한 응답이 캐시에 그대로 있고 받아 오는 중인 요청이 없을 때만 leader 로 등록, 아니면 -1 */
+static int fill_start(cache_shard_t *shard, cache_key_t *key, cache_fill_t *f, cache_follow_t *fw)
+{
+  uint64_t hash = key->hash;
+  const char *uri = key->uri;
+  cache_flight_t *fl;
+  int found;
+
+  pthread_mutex_lock(&shard->lock);
+  found = find_hashed(shard, key) != -1;
+  /* lock 없이 miss 한 뒤 leader 가 캐싱을 마쳤을 수 있음. 다시 조회하도록 알림 (재검증할 응답은 재검증하러 감) */
+  if (fw != NULL ? found && atomic_load_explicit(&key->found->state, memory_order_relaxed) != CACHE_REVALIDATE
+                 : !found || !atomic_load_explicit(&key->found->refreshing, memory_order_relaxed))
+  {
+    pthread_mutex_unlock(&shard->lock);
+    return -1;
+  }
+  if (fw != NULL)
+    POLICY_OP(shard, access)(shard->policy_state, hash); // miss 도 요청 한 번 (leader / follower 모두)
+  for (fl = shard->flights; fl != NULL; fl = fl->next)
+    if (fl->hash == hash && !strcmp(fl->uri, uri))
+      break;
+
+  /* 이미 받아 오는 중인 갱신은 건너뜀 (그 leader 가 끝나면 응답이 새로 바뀜) */
+  if (fl != NULL && fw == NULL)
+  {
+    pthread_mutex_unlock(&shard->lock);
+    return -1;
+  }
+
+  /* 이미 받아 오는 중. follower 로 붙어서 첫 segment 부터 읽음 */
+  if (fl != NULL)
+  {
+    atomic_fetch_add_explicit(&fl->refcnt, 1, memory_order_relaxed);
+    pthread_mutex_lock(&fl->lock);
+    fl->nfollowers++;
+    fw->seg = fl->head; // 등록되어 있는 동안은 head 가 있음
+    atomic_fetch_add_explicit(&fw->seg->refcnt, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&fl->lock);
+    pthread_mutex_unlock(&shard->lock);
+    fw->flight = fl;
+    fw->off = 0;
+    fw->pos = 0;
+    fw->waiter = NULL;
+    return 1;
+  }
+
+  /* leader 로 등록. 첫 segment 는 미리 만들어 둬서 follower 가 언제 붙어도 시작점이 있게 함 */
+  fl = Calloc(1, sizeof(cache_flight_t));
+  atomic_init(&fl->refcnt, 1);
+  fl->hash = hash;
+  fl->uri = strdup(uri);
+  fl->shard = shard;
+  pthread_mutex_init(&fl->lock, NULL);
+  pthread_cond_init(&fl->cond, NULL);
+  f->tail = seg_alloc(); // fill 의 참조
+  fl->head = f->tail;
+  atomic_fetch_add_explicit(&fl->head->refcnt, 1, memory_order_relaxed); // flight 의 참조
+  fl->linked = 1;
+  fl->next = shard->flights;
+  shard->flights = fl;
+  if ((f->stale = found ? key->found : NULL) != NULL) // 캐시의 참조가 남아 있는 동안 (lock 안에서) 참조를 잡음
+    atomic_fetch_add_explicit(&f->stale->refcnt, 1, memory_order_relaxed);
+  pthread_mutex_unlock(&shard->lock);
+
+  f->flight = fl;
+  f->len = 0;
+  f->cacheable = 1;
+  f->hdr_len = 0;
+  f->expires_ms = 0;
+  f->not_modified = 0;
+  f->disk.len = 0;
+  return 0;
+}
+
+int cache_fill_start(Cache *cache, char *uri, cache_fill_t *f, cache_follow_t *fw)
+{
+  cache_key_t key = {hindex_hash(uri), uri, NULL};
+
+  drain_reads(); // 입장을 판단하기 전에 이 thread 가 모아 둔 hit 부터 반영
+  return fill_start(shard_of(cache, key.hash), &key, f, fw);
+}
+
+void cache_refresh_next(cache_fill_t *f, char *uri, size_t size)
+{
+  while (1)
+  {
+    cache_refresh_t *r;
+    cache_key_t key;
+    int rc;
+
+    pthread_mutex_lock(&refresh_lock);
+    while (refresh_head == NULL)
+      pthread_cond_wait(&refresh_cond, &refresh_lock);
+    r = refresh_head;
+    if ((refresh_head = r->next) == NULL)
+      refresh_tail = &refresh_head;
+    refresh_len--;
+    pthread_mutex_unlock(&refresh_lock);
+
+    key.hash = hindex_hash(r->uri);
+    key.uri = r->uri;
+    key.found = NULL;
+    if ((rc = fill_start(r->shard, &key, f, NULL)) == 0)
+      snprintf(uri, size, "%s", r->uri);
+    free(r->uri);
+    free(r);
+    if (rc == 0)
+      return;
+  }
+}
+
+void cache_fill_pass(cache_fill_t *f)
+{
+  f->flight = NULL;
+  f->tail = seg_alloc();
+  f->len = 0;
+  f->cacheable = 0;
+  f->hdr_len = 0;
+  f->expires_ms = 0;
+  f->stale = NULL;
+  f->not_modified = 0;
+  f->disk.len = 0;
+}
+
+size_t cache_fill_conditional(cache_fill_t *f, char *buf, size_t size)
+{
+  const char *etag, *lm;
+  size_t etag_len = 0, lm_len = 0, len;
+
+  if (f->stale == NULL)
+    return 0;
+  etag = http_field(f->stale->hdr, f->stale->hdr_len, "ETag", &etag_len);
+  lm = http_field(f->stale->hdr, f->stale->hdr_len, "Last-Modified", &lm_len);
+  len = (etag != NULL ? etag_len + 17 : 0) + (lm != NULL ? lm_len + 21 : 0); // "If-None-Match: " + "\r\n" 등
+  if (len == 0 || len >= size)
+    return 0;
+  len = 0;
+  if (etag != NULL)
+    len += sprintf(buf + len, "If-None-Match: %.*s\r\n", (int)etag_len, etag);
+  if (lm != NULL)
+    len += sprintf(buf + len, "If-Modified-Since: %.*s\r\n", (int)lm_len, lm);
+  return len;
+}
+
+/* ttl 초 뒤에 만료. 인기 있으면 신선한 기간의 마지막 CACHE_REFRESH_AHEAD_PCT% 에 들어설 때 미리 갱신 */
+static void fill_set_expiry(cache_fill_t *f, const freshness_t *fr, long ttl)
+{
+  long long ms = ttl * 1000LL;
+
+  if (f->disk.len > 0 && ms > f->disk.ttl_ms) // 디스크에서 읽은 응답. 내릴 때 남아 있던 기간을 넘기지 않음
+    ms = f->disk.ttl_ms;
+  f->expires_ms = tw_now_ms() + ms;
+  f->refresh_ms = f->expires_ms - ms * CACHE_REFRESH_AHEAD_PCT / 100;
+  f->swr = fr->swr;
+  f->sie = fr->sie;
+}
+
+/* 재검증하던 응답의 stale-if-error 기간이 아직 끝나지 않았는지 */
+static int stale_usable(cache_shard_t *shard, cache_entry_t *e)
+{
+  int usable;
+
+  pthread_mutex_lock(&shard->lock);
+  usable = tw_now_ms() < e->expires_ms + e->sie * 1000LL;
+  pthread_mutex_unlock(&shard->lock);
+  return usable;
+}
+
+/* 재검증하던 응답의 참조를 놓음. 갱신 중 표시도 풀어서 다음 hit 이나 만료 처리가 다시 갱신을 요청할 수 있게 함 */
+static void fill_drop_stale(cache_fill_t *f)
+{
+  if (f->stale == NULL)
+    return;
+  atomic_store_explicit(&f->stale->refreshing, 0, memory_order_relaxed);
+  cache_release(f->stale);
+  f->stale = NULL;
+}
+
+/* 응답 헤더가 다 왔으면 한 번만 읽어서 캐싱할지, 언제까지 신선한지 정함 (force 면 지금까지 받은 것을 헤더로 봄).
+   공유하면 안 되는 응답이면 캐싱을 포기하고 기다리던 follower 를 각자 웹 서버로 보냄. 헤더가 아직이면 0 */
+static int fill_check_header(cache_fill_t *f, int force)
+{
+  cache_flight_t *fl = f->flight;
+  size_t hdr_len = header_length(fl->head); // 등록이 풀리기 전이므로 head 가 있음
+  freshness_t fr;
+  char *hdr;
+  long ttl;
+
+  if (hdr_len == 0 && !force)
+    return 0;
+  f->hdr_len = hdr_len > 0 ? hdr_len : f->len;
+  hdr = Malloc(f->hdr_len + 1);
+  seg_copy(fl->head, hdr, f->hdr_len);
+  hdr[f->hdr_len] = '\0';
+  freshness_parse(hdr, &fr);
+
+  /* 재검증 결과. stale-if-error 기간의 5xx 면 만료 시각은 그대로 두고 캐시의 응답을 대신 보냄 */
+  if (f->stale != NULL && fr.status >= 500 && stale_usable(fl->shard, f->stale))
+  {
+    free(hdr);
+    f->expires_ms = 0;
+    f->not_modified = 1;
+    f->cacheable = 0;
+    return 1;
+  }
+  /* 304 면 저장해 둔 응답의 헤더에 304 의 헤더를 덮어써서 신선한 기간을 다시 정함 (0 이하면 재검증할 응답인 채로 둠) */
+  if (f->stale != NULL && fr.status == 304)
+  {
+    char *stored = Malloc(f->stale->hdr_len + 1);
+
+    memcpy(stored, f->stale->hdr, f->stale->hdr_len);
+    stored[f->stale->hdr_len] = '\0';
+    freshness_parse(stored, &fr);
+    freshness_update(hdr, &fr);
+    free(stored);
+    free(hdr);
+    if ((ttl = freshness_ttl(&fr, time(NULL))) > 0)
+      fill_set_expiry(f, &fr, ttl);
+    else
+      f->expires_ms = 0;
+    f->not_modified = 1;
+    f->cacheable = 0;
+    return 1;
+  }
+  free(hdr);
+  fill_drop_stale(f); // 바뀐 응답. 보통 miss 처럼 받아서 캐시의 응답과 바꿔 끼움
+
+  if ((ttl = freshness_ttl(&fr, time(NULL))) > 0)
+  {
+    fill_set_expiry(f, &fr, ttl);
+    return 1;
+  }
+  f->cacheable = 0;
+  pthread_mutex_lock(&fl->lock);
+  fl->pass = 1;
+  flight_wake(fl);
+  pthread_mutex_unlock(&fl->lock);
+  flight_unregister(fl);
+  return 1;
+}
+
+char *cache_fill_buf(cache_fill_t *f, size_t *room)
+{
+  if (f->tail->len == CACHE_SEG_SIZE)
+  {
+    cache_seg_t *s = seg_alloc(); // fill 의 참조
+
+    atomic_fetch_add_explicit(&s->refcnt, 1, memory_order_relaxed); // 앞 segment 의 참조
+    f->tail->next = s; // follower 는 commit 으로 공개된 뒤에야 따라옴
+    seg_release(f->tail);
+    f->tail = s;
+  }
+  *room = CACHE_SEG_SIZE - f->tail->len;
+  return f->tail->data + f->tail->len;
+}
+
+size_t cache_fill_commit(cache_fill_t *f, size_t n, char **p)
+{
+  cache_flight_t *fl = f->flight;
+  cache_seg_t *s = f->tail;
+  int held = f->stale != NULL && f->hdr_len == 0; // 재검증 중. 304 인지 알 때까지 클라이언트에도 보내지 않음
+
+  *p = s->data + s->len;
+  f->len += n;
+  if (f->not_modified) // 304 뒤에 오는 것 (보통 없음) 은 버림
+    return 0;
+  /* 캐싱을 포기했고 이 segment 를 볼 수 있는 follower 도 없음 (fill 의 참조뿐).
+     중계 버퍼로만 쓰고 다음에도 같은 자리를 내줌 */
+  if (!f->cacheable && atomic_load_explicit(&s->refcnt, memory_order_acquire) == 1)
+  {
+    s->len = 0;
+    return n;
+  }
+  s->len += n;
+
+  /* 헤더를 보기 전에는 follower 에게 아무것도 보여 주지 않음. 재검증 중이면 모아 둔 byte 가 첫 segment 를 넘기 전에 정함 */
+  if (f->hdr_len == 0 && !fill_check_header(f, f->len >= (held ? CACHE_SEG_SIZE : MAX_OBJECT_SIZE)))
+    return held ? 0 : n;
+  if (f->not_modified)
+    return 0;
+  if (held) // 304 가 아님. 모아 둔 byte 는 모두 첫 segment 에 있음
+  {
+    *p = s->data;
+    n = f->len;
+  }
+  if (fl->pass)
+    return n;
+
+  pthread_mutex_lock(&fl->lock);
+  fl->len = f->len;
+  flight_wake(fl);
+  pthread_mutex_unlock(&fl->lock);
+
+  /* 캐싱 포기. 새 follower 는 받지 않고, 앞 segment 들은 붙어 있는 follower 가 다 읽는 대로 free */
+  if (f->cacheable && f->len >= MAX_OBJECT_SIZE)
+  {
+    f->cacheable = 0;
+    flight_unregister(fl);
+  }
+  return n;
+}
+
+int cache_fill_disk(cache_fill_t *f)
+{
+  if (f->flight == NULL || f->stale != NULL || !disk_get(f->flight->hash, f->flight->uri, &f->disk))
+  {
+    f->disk.len = 0;
+    return 0;
+  }
+  log_hit("disk", f->flight->uri);
+  return 1;
+}
+
+ssize_t cache_fill_disk_next(cache_fill_t *f, char **p)
+{
+  size_t room;
+  ssize_t n;
+
+  *p = cache_fill_buf(f, &room);
+  if ((n = disk_read(&f->disk, *p, room)) <= 0)
+    return n;
+  return cache_fill_commit(f, n, p); // 재검증이 아니므로 n 그대로
+}
+
+int cache_fill_shared(cache_fill_t *f)
+{
+  int shared;
+
+  if (f->flight == NULL)
+    return 0;
+  pthread_mutex_lock(&f->flight->lock);
+  shared = f->flight->nfollowers > 0;
+  pthread_mutex_unlock(&f->flight->lock);
+  return shared;
+}
+
+/* leader 가 끝남 (done: 1 끝까지 받음, -1 실패). follower 에게 알리고 leader 의 참조를 놓음 */
+static void fill_end(cache_fill_t *f, int done)
+{
+  cache_flight_t *fl = f->flight;
+
+  fill_drop_stale(f);
+  if (fl == NULL) // 캐싱하지 않는 중계 (cache_fill_pass) 였거나 빈 fill
+  {
+    seg_release(f->tail);
+    f->tail = NULL;
+    return;
+  }
+  flight_unregister(fl);
+  pthread_mutex_lock(&fl->lock);
+  if (done > 0 && !fl->pass)
+    fl->len = f->len;
+  fl->done = done;
+  flight_wake(fl);
+  pthread_mutex_unlock(&fl->lock);
+
+  seg_release(f->tail);
+  flight_release(fl);
+  f->flight = NULL;
+  f->tail = NULL;
+}
+
+void cache_fill_abort(cache_fill_t *f)
+{
+  fill_end(f, -1);
+}
+
+/* 새 entry 를 shard 에 넣음. shard->lock 을 잡은 상태에서 호출 */
+static void cache_insert(cache_shard_t *shard, cache_key_t *key, cache_entry_t *e, long long refresh_ms)
+{
+  cache_block *block;
+  int index;
+
+  /* 같은 uri 를 동시에 받아 온 thread 가 먼저 캐싱했다면 그 block 의 entry 를 한 번에 바꿔 끼움.
+     읽는 쪽은 옛 entry 나 새 entry 중 하나를 온전히 봄 */
+  if ((index = find_hashed(shard, key)) != -1)
+  {
+    block = block_at(shard, index);
+    shard->used_bytes += e->bytes - key->found->bytes;
+    atomic_store_explicit(&block->entry, e, memory_order_release);
+    POLICY_OP(shard, update)(shard->policy_state, index, e->bytes);
+    ((cache_expiry_t *)expiry_at(shard, index))->hits = 0;
+    tw_add(&shard->expiry, expiry_at(shard, index), refresh_ms);
+    epoch_retire(key->found, entry_retired);
+    cache_evict(shard);
+    return;
+  }
+
+  if ((index = cache_alloc_block(shard)) < 0) // cache block 수 한계. 정책이 고른 block 을 비워서 씀
+  {
+    cache_demote(shard, POLICY_OP(shard, victim)(shard->policy_state));
+    index = cache_alloc_block(shard);
+  }
+
+  block = block_at(shard, index);
+  atomic_store_explicit(&block->entry, e, memory_order_release); // index 에 넣기 전에 entry 부터 보이게 함
+  shard->used_bytes += e->bytes;
+  hindex_insert(&shard->index, key->hash, index);
+  POLICY_OP(shard, insert)(shard->policy_state, index, key->hash, e->bytes);
+  ((cache_expiry_t *)expiry_at(shard, index))->hits = 0;
+  tw_add(&shard->expiry, expiry_at(shard, index), refresh_ms);
+  cache_evict(shard);
+}
+
+/* 304 로 재검증됨 (또는 stale-if-error 로 캐시의 응답을 대신 씀). 캐시에 아직 같은 응답이 있고 새 만료 시각이 있으면
+   본문은 그대로 두고 만료 시각만 다시 걸고, follower 에게는 받은 응답 대신 이 응답을 읽게 함. leader 가 보낼 응답 (참조 하나) 을 돌려줌 */
+static cache_entry_t *fill_revalidated(cache_fill_t *f)
+{
+  cache_flight_t *fl = f->flight;
+  cache_shard_t *shard = fl->shard;
+  cache_key_t key = {fl->hash, fl->uri, NULL};
+  cache_entry_t *e = f->stale;
+  int index;
+
+  pthread_mutex_lock(&shard->lock);
+  if ((index = find_hashed(shard, &key)) != -1 && key.found == e && f->expires_ms > 0)
+  {
+    e->expires_ms = f->expires_ms;
+    e->swr = f->swr;
+    e->sie = f->sie;
+    atomic_store_explicit(&e->state, CACHE_FRESH, memory_order_relaxed);
+    ((cache_expiry_t *)expiry_at(shard, index))->hits = 0;
+    tw_add(&shard->expiry, expiry_at(shard, index), f->refresh_ms);
+  }
+  pthread_mutex_unlock(&shard->lock);
+  atomic_store_explicit(&e->refreshing, 0, memory_order_relaxed);
+
+  atomic_fetch_add_explicit(&e->refcnt, 1, memory_order_relaxed); // flight 의 참조
+  pthread_mutex_lock(&fl->lock);
+  fl->entry = e;
+  pthread_mutex_unlock(&fl->lock);
+  f->stale = NULL; // leader 의 참조는 돌려줌
+  fill_end(f, 1);
+  return e;
+}
+
+/* 응답 캐싱. 본문 segment 는 복사하지 않고 entry 가 넘겨받음 (헤더만 entry 안에 복사).
+   flight 등록을 지우는 것과 캐시에 넣는 것을 같은 lock 안에서 해서, 그 사이에 들어온 miss 가 웹 서버로 가지 않게 함 */
+cache_entry_t *cache_fill_finish(cache_fill_t *f)
+{
+  cache_flight_t *fl = f->flight;
+  cache_shard_t *shard;
+  cache_key_t key;
+  size_t uri_len, hdr_len, off, bytes, tail_size = CACHE_SEG_SIZE;
+  cache_seg_t *head, *body, **pp;
+  cache_entry_t *e;
+  int shared;
+
+  if (f->flight != NULL && f->cacheable && f->hdr_len == 0 && f->len > 0) // 빈 줄 없이 끝난 응답
+    fill_check_header(f, 1);
+  if (f->not_modified)
+    return fill_revalidated(f);
+  if (fl != NULL && f->disk.len == 0 && f->len > 0) // 웹 서버에서 새로 받은 응답. 디스크의 옛 응답은 더 쓰지 않음
+    disk_forget(fl->hash);
+  if (!f->cacheable || f->len == 0)
+  {
+    fill_end(f, 1);
+    return NULL;
+  }
+  shard = fl->shard;
+  key.hash = fl->hash;
+  key.uri = fl->uri;
+  uri_len = strlen(fl->uri);
+
+  pthread_mutex_lock(&shard->lock);
+  flight_unlink(fl);
+  pthread_mutex_lock(&fl->lock);
+  head = fl->head;
+  fl->head = NULL;
+  fl->len = f->len;
+  fl->done = 1;
+  shared = fl->nfollowers > 0;
+  flight_wake(fl);
+  pthread_mutex_unlock(&fl->lock);
+
+  /* 마지막 segment 는 받은 만큼으로 줄임. 등록이 풀려서 이제 읽는 follower 가 없고, 떠나는 follower 도 참조를 다 놓았을 때만
+     (fill 의 참조와 앞 segment 또는 head 의 참조 둘뿐). 떠나는 follower 는 nfollowers 를 줄인 뒤에 lock 밖에서 seg_release 함 */
+  if (!shared && f->tail->len < CACHE_SEG_SIZE && atomic_load_explicit(&f->tail->refcnt, memory_order_acquire) == 2)
+  {
+    for (pp = &head; *pp != f->tail; pp = &(*pp)->next)
+      ;
+    f->tail = *pp = Realloc(f->tail, sizeof(cache_seg_t) + f->tail->len);
+    tail_size = f->tail->len;
+  }
+
+  /* 헤더만 든 segment 는 entry 에 넘기지 않음 */
+  hdr_len = f->hdr_len;
+  for (body = head, off = hdr_len; body != NULL && off >= body->len; body = body->next)
+    off -= body->len;
+  bytes = sizeof(cache_block) + sizeof(cache_expiry_t) + sizeof(policy_node_t) + sizeof(cache_entry_t) + uri_len + 1 + hdr_len;
+  for (cache_seg_t *s = body; s != NULL; s = s->next)
+    bytes += sizeof(cache_seg_t) + (s == f->tail ? tail_size : s->len);
+
+  if (bytes <= shard->max_bytes)
+  {
+    e = Malloc(sizeof(cache_entry_t) + uri_len + 1 + hdr_len);
+    atomic_init(&e->refcnt, 1); // 캐시의 참조
+    e->hash = key.hash;
+    e->bytes = bytes;
+    e->expires_ms = f->expires_ms;
+    e->swr = f->swr;
+    e->sie = f->sie;
+    atomic_init(&e->state, CACHE_FRESH);
+    atomic_init(&e->refreshing, 0);
+    e->disk_rec = f->disk.len > 0 ? f->disk.rec : 0;
+    e->uri = e->data;
+    memcpy(e->uri, fl->uri, uri_len + 1);
+    e->hdr = e->uri + uri_len + 1;
+    e->hdr_len = hdr_len;
+    seg_copy(head, e->hdr, hdr_len);
+    e->body = body;
+    e->body_off = off;
+    e->body_len = f->len - hdr_len;
+    if (body != NULL)
+      atomic_fetch_add_explicit(&body->refcnt, 1, memory_order_relaxed); // entry 의 참조
+    cache_insert(shard, &key, e, f->refresh_ms);
+  }
+  pthread_mutex_unlock(&shard->lock);
+
+  seg_release(head); // 헤더만 든 segment 는 여기서 free
+  seg_release(f->tail);
+  flight_release(fl);
+  f->flight = NULL;
+  f->tail = NULL;
+  return NULL;
+}
+
+cache_entry_t *cache_fill_error(cache_fill_t *f)
+{
+  /* 재검증하던 응답이 남아 있으면 아직 클라이언트에 아무것도 보내지 않았음 (304 를 기다리며 모아 두는 중) */
+  if (f->flight != NULL && f->stale != NULL && (f->not_modified || stale_usable(f->flight->shard, f->stale)))
+  {
+    if (!f->not_modified) // 만료 시각은 그대로
+    {
+      f->expires_ms = 0;
+      f->not_modified = 1;
+    }
+    return fill_revalidated(f);
+  }
+  cache_fill_abort(f);
+  return NULL;
+}
+
+/* e 를 처음부터 보낼 때 pos 번째 byte 부터 한 번에 넘길 수 있는 곳 (헤더, 또는 본문 segment 하나). 길이, 끝이면 0 */
+static size_t entry_piece(cache_entry_t *e, size_t pos, char **p)
+{
+  cache_seg_t *s;
+  size_t off;
+
+  if (pos < e->hdr_len)
+  {
+    *p = e->hdr + pos;
+    return e->hdr_len - pos;
+  }
+  if ((pos -= e->hdr_len) >= e->body_len)
+    return 0;
+  for (s = e->body, off = e->body_off; pos >= s->len - off; s = s->next, off = 0)
+    pos -= s->len - off;
+  *p = s->data + off + pos;
+  return s->len - off - pos;
+}
+
+ssize_t cache_follow_next(cache_follow_t *fw, char **p, cache_waiter_t *w)
+{
+  cache_flight_t *fl = fw->flight;
+  ssize_t n;
+
+  pthread_mutex_lock(&fl->lock);
+  while (fl->len == fw->pos && fl->done == 0 && !fl->pass)
+  {
+    if (w == NULL)
+    {
+      pthread_cond_wait(&fl->cond, &fl->lock);
+      continue;
+    }
+    if (!w->waiting)
+    {
+      w->waiting = 1;
+      w->next = fl->waiters;
+      fl->waiters = w;
+      fw->waiter = w;
+    }
+    pthread_mutex_unlock(&fl->lock);
+    return CACHE_FOLLOW_WAIT;
+  }
+  if (fl->pass) // leader 가 아무것도 공개하기 전에 정해짐
+  {
+    pthread_mutex_unlock(&fl->lock);
+    return CACHE_FOLLOW_PASS;
+  }
+  if (fl->entry != NULL) // 304 로 재검증됨. 캐시의 응답을 읽음 (flight 가 참조를 가짐)
+  {
+    pthread_mutex_unlock(&fl->lock);
+    return entry_piece(fl->entry, fw->pos, p);
+  }
+  if (fl->len == fw->pos) // 받은 것은 다 보냄
+  {
+    n = fl->done > 0 ? 0 : -1;
+    pthread_mutex_unlock(&fl->lock);
+    return n;
+  }
+  /* 지금 segment 를 다 읽음. leader 는 다음 segment 를 이어 붙인 뒤에 len 을 늘렸으므로 next 가 있음 */
+  if (fw->off == CACHE_SEG_SIZE)
+  {
+    cache_seg_t *old = fw->seg;
+
+    fw->seg = old->next;
+    atomic_fetch_add_explicit(&fw->seg->refcnt, 1, memory_order_relaxed);
+    seg_release(old);
+    fw->off = 0;
+  }
+  n = fl->len - fw->pos;
+  if (n > CACHE_SEG_SIZE - fw->off)
+    n = CACHE_SEG_SIZE - fw->off;
+  pthread_mutex_unlock(&fl->lock);
+  *p = fw->seg->data + fw->off;
+  return n;
+}
+
+void cache_follow_advance(cache_follow_t *fw, size_t n)
+{
+  fw->off += n;
+  fw->pos += n;
+}
+
+void cache_follow_release(cache_follow_t *fw)
+{
+  cache_flight_t *fl = fw->flight;
+
+  if (fl == NULL)
+    return;
+  pthread_mutex_lock(&fl->lock);
+  if (fw->waiter != NULL && fw->waiter->waiting) // 깨우기 전에 떠남. 대기 목록에서 뺌
+  {
+    cache_waiter_t **pp;
+    for (pp = &fl->waiters; *pp != fw->waiter; pp = &(*pp)->next)
+      ;
+    *pp = fw->waiter->next;
+    fw->waiter->waiting = 0;
+  }
+  fl->nfollowers--;
+  pthread_mutex_unlock(&fl->lock);
+
+  seg_release(fw->seg);
+  flight_release(fl);
+  fw->flight = NULL;
+  fw->seg = NULL;
+}
@@ -0,0 +1,265 @@
+/*
+    cache.h - 웹 서버 응답 캐시
+
+    캐시는 uri hash 로 고르는 shard N 개로 나뉘고, shard 마다 cache block 배열 / hash index (hindex.c) /
+    소거 정책 상태 / byte 한도 / writer lock 을 따로 가짐. 그래서 cache block 이 수십만 개여도
+    조회는 O(1) 이고, 서로 다른 shard 의 캐싱은 같은 lock 이나 cache line 을 두고 경쟁하지 않음.
+
+    응답은 실제 크기만큼만 할당하고, 캐시 전체가 쓰는 byte 수 (응답 + uri + 관리 정보) 를
+    max_bytes 안으로 유지함.
+
+    소거 / 입장은 shard 마다 정책 (policy.h) 이 정함. 캐시는 block 번호와 byte 수만 알려 주고, byte 한도를 넘으면
+    정책이 고른 block 을 소거함. 실행할 때 cache_set_policy 로 고르거나 (wtinylfu 기본, arc, s3fifo, gdsf)
+    빌드할 때 CACHE_POLICY 로 하나를 정해 함수 표 없이 직접 부르게 할 수 있음.
+    miss 는 캐싱하는 쪽에서 lock 안에 정책에 알리고, hit 은 thread 마다 CACHE_READ_BUF 개씩 모아 두었다가
+    shard lock 을 trylock 으로 잡을 수 있을 때 한 번에 알림 (못 잡으면 버림. 정확한 순서보다 hit 경로에서 lock 과
+    공유 쓰기를 없애는 쪽을 택함)
+
+    응답은 웹 서버가 헤더로 알려 준 만큼만 캐싱함 (RFC 9111, freshness.c). leader 가 응답 헤더를 다 받은 순간 한 번만 읽어서
+    - no-store / private / no-cache 거나 이미 만료된 응답은 캐싱하지 않음
+    - 나머지는 s-maxage, max-age, Expires (또는 heuristic) 로 정한 만료 시각을 entry 에 적고 shard 의 timer wheel 에 검
+    만료 처리는 조회하는 쪽이 아니라 캐시 전체에 하나인 만료 처리 thread 가 CACHE_EXPIRE_TICK_MS 마다 함
+    (hit 경로에 시계 읽기와 비교를 넣지 않으므로 만료된 응답이 최대 한 tick 더 보일 수 있음)
+    만료된 응답에 validator (ETag, Last-Modified) 가 있으면 소거하지 않고 재검증할 응답 (CACHE_REVALIDATE) 으로 표시만 함.
+    그런 응답은 hit 이 아니라 miss 로 처리하되, leader 가 그 응답의 validator 로 조건부 요청 (If-None-Match, If-Modified-Since) 을 보내서
+    - 304 면 본문은 그대로 두고 만료 시각만 다시 정해서 (304 의 헤더로) 캐시의 응답을 보냄. 웹 서버에서는 헤더 몇백 byte 만 옴
+    - 그 밖의 응답이면 보통 miss 처럼 받아서 캐싱 (만료된 응답을 바꿔 끼움)
+    leader 는 304 인지 알기 전에는 자기 클라이언트에 아무것도 보내지 않음 (응답 헤더를 첫 segment 안에서 모아 둠)
+
+    만료 전후로 웹 서버를 기다리는 요청이 몰리지 않게 (RFC 5861)
+    - 미리 갱신 : 신선한 기간의 마지막 CACHE_REFRESH_AHEAD_PCT% 에 들어설 때 그동안 hit 이 CACHE_REFRESH_HITS 번 이상이었으면
+                  만료되기 전에 갱신을 요청함 (hit 수는 정책에 반영된 것만 셈)
+    - stale-while-revalidate : 그 기간에는 만료된 응답 (CACHE_STALE) 을 hit 으로 바로 보내고 갱신을 요청함
+    갱신 요청은 캐시 전체에 하나인 queue 에 넣고, 백그라운드 갱신 thread 가 cache_refresh_next 로 꺼내서
+    클라이언트 없는 leader 로 받아 옴 (재검증과 같은 조건부 요청). uri 마다 queue 에 있거나 받아 오는 중인 갱신은 하나뿐
+    - stale-if-error : 그 기간에는 재검증하는 leader 가 웹 서버에 연결하지 못하거나 5xx 를 받으면 (cache_fill_error)
+                  만료된 응답을 대신 보냄
+
+    조회 (hit) 는 lock 을 잡지 않고 공유 메모리에 아무것도 쓰지 않음:
+    - 캐싱된 응답 (cache_entry_t) 은 만든 뒤 바뀌지 않고, cache block 의 entry 포인터를 통째로 바꿔서 교체
+    - 바뀌거나 소거된 entry 와 재배치된 index table 은 epoch.c 로 넘겨서 읽던 thread 가 다 빠져나간 뒤 free
+    - hit 은 epoch 안에서 entry 를 클라이언트 socket 에 non-blocking 으로 바로 보내 봄. 다 보내면 참조 카운트도
+      건드리지 않고, 클라이언트가 느려서 다 못 보냈을 때만 참조를 잡고 (refcnt 증가) epoch 를 빠져나감.
+      그래서 느린 클라이언트가 lock 이나 epoch 를 붙잡고 있지 않고, 캐싱 (교체 / 소거) 은 기다리지 않음.
+      교체 / 소거된 entry 는 캐시의 참조를 놓고, 마지막 참조가 놓일 때 free
+    - hit 기록은 thread 마다 가진 read buffer 에만 씀 (위 소거 정책 참고)
+
+    miss 응답은 따로 모아 두지 않음. 웹 서버에서 읽은 byte 를 바로 cache segment (cache_fill_t) 에 받아서
+    그 자리에서 클라이언트로 보내고, 끝나면 segment 묶음을 복사 없이 그대로 entry 에 넘김.
+    MAX_OBJECT_SIZE 를 넘는 순간 모은 segment 를 놓고 segment 하나만 중계 버퍼로 계속 씀
+
+    같은 uri 의 miss 가 동시에 여럿이면 웹 서버에는 한 번만 요청함 (collapsed forwarding).
+    처음 miss 한 요청이 leader 로 shard 의 flights 목록에 등록하고 응답을 받아 오며, 그동안 같은 uri 로 들어온
+    요청은 follower 로 붙어서 leader 가 받은 segment 를 받는 대로 자기 클라이언트에 보냄. follower 는 leader 가 응답 헤더를
+    보고 공유해도 되는 응답인지 정할 때까지 기다리고, 공유하면 안 되는 응답 (private 등) 이면 각자 웹 서버에 요청함. 도중에 붙은 follower 도
+    첫 segment 부터 읽음. follower 마다 지금 읽는 segment 의 참조를 잡으므로 이미 다 읽힌 segment 는 바로 free 되고,
+    MAX_OBJECT_SIZE 를 넘어 캐싱을 포기한 응답도 붙어 있던 follower 는 끝까지 받음 (그 뒤로는 새로 붙지 않음)
+
+    디스크 tier (disk.h, -d 로 켬) 가 있으면 byte 한도 때문에 소거되는 신선한 응답을 디스크로 내림. 소거하는 쪽은 lock 안에서
+    참조를 잡아 queue 에 넣기만 하고, 디스크 thread 가 헤더 / 본문 segment 를 그대로 pwritev 함.
+    miss 한 leader 는 웹 서버에 가기 전에 디스크를 찾아보고 (cache_fill_disk), 있으면 웹 서버 대신 디스크에서 segment 에 바로
+    pread 해서 클라이언트와 follower 에게 보내고 메모리로 다시 올림. 만료 시각은 디스크로 내릴 때 남아 있던 만큼만
+*/
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdatomic.h>
+#include "csapp.h"
+#include "hindex.h"
+#include "policy.h"
+#include "timer.h"
+#include "disk.h"
+
+#define MAX_CACHE_SIZE 1049000 // 기본 캐시 byte 한도 (-c 로 변경)
+#define MAX_OBJECT_SIZE 102400 // 이보다 큰 응답은 캐싱하지 않음
+#define CACHE_SHARDS 16        // 기본 shard 수 (-s 로 변경)
+#define CACHE_CACHELINE 64
+#define CACHE_CHUNK 1024       // cache block 을 이 개수씩 묶어서 할당 (한 번 할당한 block 은 옮기지 않음)
+#define CACHE_MAX_CHUNKS 1024  // shard 하나의 최대 cache block 수 = CACHE_CHUNK * CACHE_MAX_CHUNKS
+#define CACHE_SEG_SIZE 16384   // 응답을 받아 두는 segment 크기. miss 중계 버퍼도 겸함
+#define CACHE_READ_BUF 32      // thread 마다 hit 기록을 이만큼 모았다가 한 번에 반영
+#define CACHE_EXPIRE_TICK_MS 100 // 만료 처리 주기
+#define CACHE_REFRESH_AHEAD_PCT 10 // 신선한 기간의 마지막 이만큼 (%) 에서 미리 갱신
+#define CACHE_REFRESH_HITS 8       // 미리 갱신할 만큼 인기 있는 응답의 hit 수
+#define CACHE_REFRESH_MAX 1024     // 갱신 queue 길이 한도. 넘치면 요청을 버림 (다음 hit 이 다시 요청)
+#define CACHE_DEMOTE_MAX 256       // 디스크로 내릴 응답 queue 길이 한도. 넘치면 내리지 않고 버림
+#define CACHE_DEMOTE_MIN_TTL_MS 1000 // 신선한 기간이 이보다 적게 남은 응답은 디스크로 내리지 않음
+
+/* 응답 조각. 앞 segment (또는 entry) 가 next 로 참조 하나를 가짐. 다 채운 뒤에는 바뀌지 않음 */
+typedef struct cache_seg
+{
+  atomic_int refcnt;
+  struct cache_seg *next;
+  size_t len;
+  char data[]; // 채우는 동안은 CACHE_SEG_SIZE, 캐싱할 때 마지막 segment 는 len 만큼으로 줄임
+} cache_seg_t;
+
+/* entry 의 상태 */
+#define CACHE_FRESH 0      // 신선함
+#define CACHE_STALE 1      // stale-while-revalidate 기간. hit 으로 보내고 백그라운드 갱신
+#define CACHE_REVALIDATE 2 // 재검증해야 함. miss 로 처리하고 leader 가 조건부 요청
+
+/* 캐싱된 응답 하나. 만든 뒤에는 state / expires_ms / swr / sie (shard lock 안에서 바꿈) 말고는 바뀌지 않음.
+   uri 와 응답 헤더는 entry 와 같은 할당 안에 있고, 본문은 웹 서버에서 받은 segment 묶음을 그대로 가리킴.
+   길이를 따로 가지므로 '\0' 이 든 응답 (이미지, 동영상) 도 그대로 캐싱됨 */
+typedef struct
+{
+  atomic_int refcnt; // 캐시가 가진 참조 1 + 전송 중인 연결 수
+  uint64_t hash;     // uri 의 hash. 비교할 때 strcmp 전에 먼저 봄
+  size_t bytes;      // 캐시 한도에서 차지하는 byte 수
+  long long expires_ms; // 신선한 기간이 끝나는 시각 (tw_now_ms 기준)
+  int swr, sie;         // stale-while-revalidate, stale-if-error (초)
+  atomic_int state;     // CACHE_FRESH, CACHE_STALE, CACHE_REVALIDATE
+  atomic_int refreshing; // 갱신 요청이 queue 에 있거나 받아 오는 중
+  uint64_t disk_rec;     // 디스크 tier 에서 읽어 온 응답이면 그 기록 번호 (아직 있으면 다시 내리지 않음)
+  char *uri;
+  char *hdr;         // 응답 status line + 헤더 (빈 줄까지)
+  size_t hdr_len;
+  cache_seg_t *body; // 본문이 시작하는 segment (본문이 없으면 NULL)
+  size_t body_off;   // 그 segment 안에서 본문이 시작하는 위치
+  size_t body_len;
+  char data[];       // uri, hdr 가 차례로 들어 있음
+} cache_entry_t;
+
+#define CACHE_ENTRY_LEN(e) ((e)->hdr_len + (e)->body_len) // 보낼 전체 길이
+
+typedef struct
+{
+  _Atomic(cache_entry_t *) entry; // NULL 이면 빈 block
+} cache_block;
+
+/* cache block 마다 하나. entry 의 미리 갱신 / 만료 시각에 상태를 바꾸는 timer (writer 만 씀) */
+typedef struct
+{
+  tw_timer_t timer; // arg 는 shard
+  int index;
+  int hits;         // 캐싱하거나 갱신한 뒤의 hit 수
+} cache_expiry_t;
+
+typedef struct
+{
+  _Alignas(CACHE_CACHELINE) pthread_mutex_t lock;  // 이 shard 에 캐싱하는 thread 끼리만 잡음 (조회는 잡지 않음)
+  _Atomic(cache_block *) chunks[CACHE_MAX_CHUNKS]; // cache block 묶음
+  int nblocks;      // 할당된 cache block 수
+  int nused;        // 한 번이라도 쓰인 cache block 수. 앞에서부터 차례로 채움
+  int *free_blocks; // 소거되어 비어 있는 cache block 번호 (stack)
+  int nfree;
+  size_t max_bytes; // 이 shard 의 byte 한도
+  size_t used_bytes;
+  hindex_t index;   // uri hash -> cache block 번호
+  const cache_policy_t *policy; // 소거 정책 (shard 마다 상태가 따로)
+  void *policy_state;
+  timer_wheel_t expiry;                         // 만료 시각
+  cache_expiry_t *expiry_chunks[CACHE_MAX_CHUNKS]; // chunks 와 같은 번호로
+  struct cache_flight *flights; // 웹 서버에서 받아 오는 중인 응답들
+} cache_shard_t;
+
+typedef struct
+{
+  cache_shard_t *shards;
+  int nshards; // 2의 거듭제곱
+} Cache;
+
+/* 이후 cache_init 하는 캐시의 소거 정책을 이름으로 고름. 없는 정책 (빌드할 때 정했으면 그 외의 정책) 은 -1 */
+int cache_set_policy(const char *name);
+const char *cache_policy_name(void);
+
+/* max_bytes 를 nshards 개 shard 가 나눠 가짐. shard 하나의 몫이 MAX_OBJECT_SIZE 보다 작아지면 shard 수를 줄임 */
+void cache_init(Cache *cache, size_t max_bytes, int nshards);
+
+typedef struct cache_flight cache_flight_t; // 받아 오는 중인 응답 하나 (leader 와 follower 들이 나눠 가짐)
+
+/* event loop 의 follower 가 기다리는 방법. 새 데이터가 오거나 끝나면 leader 쪽에서 wake 를 한 번 부름
+   (flight lock 을 잡은 채로 부르므로 wake 는 표시만 하고 바로 돌아와야 함) */
+typedef struct cache_waiter
+{
+  void (*wake)(struct cache_waiter *w);
+  struct cache_waiter *next;
+  int waiting; // flight 의 대기 목록에 들어 있는지
+} cache_waiter_t;
+
+/* leader: 웹 서버 응답을 segment 에 바로 받으면서 모으는 중인 캐싱. 0 으로 채운 것은 cache_fill_abort 만 해도 됨 */
+typedef struct
+{
+  cache_flight_t *flight;
+  cache_seg_t *tail; // 지금 채우는 segment (참조 하나)
+  size_t len;        // 지금까지 받은 byte 수 (캐싱을 포기한 뒤에도 셈)
+  int cacheable;     // 아직 MAX_OBJECT_SIZE 를 넘지 않았고 캐싱해도 되는 응답인지
+  size_t hdr_len;    // 응답 헤더 길이. 헤더를 다 받기 전에는 0
+  long long expires_ms; // 캐싱하면 이 시각에 만료
+  long long refresh_ms; // 인기 있으면 이 시각에 미리 갱신
+  int swr, sie;
+  cache_entry_t *stale; // 재검증하는 캐시의 응답 (참조 하나). 조건부 요청을 보냄
+  int not_modified;     // 웹 서버가 304 (또는 stale-if-error 기간의 5xx) 로 답함. 캐시의 응답을 씀. 받는 것은 클라이언트에 보내지 않음
+  disk_obj_t disk;      // 웹 서버 대신 디스크 tier 에서 읽는 중이면 disk.len > 0
+} cache_fill_t;
+
+/* follower: leader 가 받은 응답을 읽는 위치. 0 으로 채운 것은 cache_follow_release 만 해도 됨 */
+typedef struct
+{
+  cache_flight_t *flight;
+  cache_seg_t *seg; // 지금 읽는 segment (참조 하나)
+  size_t off;       // seg 안의 위치
+  size_t pos;       // 지금까지 보낸 byte 수
+  cache_waiter_t *waiter;
+} cache_follow_t;
+
+#define CACHE_FOLLOW_WAIT -2 // cache_follow_next: 아직 새 데이터가 없음
+#define CACHE_FOLLOW_PASS -3 // cache_follow_next: 공유하면 안 되는 응답. cache_follow_release 하고 직접 웹 서버에 요청
+
+/* e 의 sent 번째 byte 부터 끝까지를 헤더 / 본문 segment 들 그대로 sendmsg 한 번으로 보냄 (flags 는 send 플래그).
+   보낸 byte 수, 실패하면 -1 */
+ssize_t cache_entry_send(cache_entry_t *e, int fd, size_t sent, int flags);
+
+/* 캐시 hit 이면 응답을 fd 로 non-blocking 으로 보내 봄. miss 면 -1.
+   다 보냈거나 클라이언트가 끊었으면 0, 다 못 보냈으면 1: *hit 에 참조를 잡은 entry, *sent 에 이미 보낸 byte 수.
+   나머지를 보낸 뒤 cache_release(*hit) 할 것 */
+int cache_send(Cache *cache, char *uri, int fd, cache_entry_t **hit, size_t *sent);
+void cache_release(cache_entry_t *e);
+
+/* cache miss 뒤에 부름. 같은 uri 를 받아 오는 중인 요청이 없으면 leader 로 등록하고 f 를 준비한 뒤 0,
+   있으면 follower 로 붙이고 fw 를 준비한 뒤 1. 그 사이에 캐싱이 끝났으면 -1 (cache_send 부터 다시).
+   캐시에 재검증할 응답이 있었으면 leader 는 그 응답을 재검증함 (f->stale) */
+int cache_fill_start(Cache *cache, char *uri, cache_fill_t *f, cache_follow_t *fw);
+/* 백그라운드 갱신. 갱신 요청이 올 때까지 block 하고, 캐시의 응답을 재검증하는 leader 로 f 를 준비한 뒤 그 uri 를 돌려줌.
+   받아 오는 것은 leader 와 같고, 클라이언트가 없으므로 commit 이 돌려주는 byte 는 버림 */
+void cache_refresh_next(cache_fill_t *f, char *uri, size_t size);
+/* 캐싱하지 않고 중계 버퍼로만 쓰는 fill (CACHE_FOLLOW_PASS 를 받은 follower 용). 사용법은 leader 와 같음 */
+void cache_fill_pass(cache_fill_t *f);
+/* 재검증하는 leader 면 웹 서버에 보낼 조건부 요청 헤더 (If-None-Match, If-Modified-Since 줄) 를 buf 에 씀.
+   쓴 길이, 재검증이 아니거나 size 가 모자라면 0 */
+size_t cache_fill_conditional(cache_fill_t *f, char *buf, size_t size);
+
+/* leader 사용법: buf = cache_fill_buf(&f, &room); n = read(fd, buf, room); len = cache_fill_commit(&f, n, &p); 그리고 p 의 len byte 를
+   클라이언트에 보냄. 보통은 p == buf, len == n 이고, 재검증 중에는 응답 헤더를 다 받을 때까지 0 이었다가 304 가 아니면
+   모아 둔 byte 를 한꺼번에, 304 면 계속 0. p 는 다음 cache_fill_buf 전까지 그대로 있음 (캐싱을 포기하면 다음에 같은 자리를 다시 내줌).
+   commit 하면 follower 들도 그 byte 를 볼 수 있음 (응답 헤더를 다 받아서 공유해도 되는 응답으로 정해진 뒤부터) */
+char *cache_fill_buf(cache_fill_t *f, size_t *room);
+size_t cache_fill_commit(cache_fill_t *f, size_t n, char **p);
+/* 디스크 tier 에 이 leader 의 uri 가 있는지 (재검증하는 leader 는 찾지 않음). 있으면 1: 웹 서버 대신
+   n = cache_fill_disk_next(&f, &p) 로 p 의 n byte 를 받아서 클라이언트에 보내고, 0 이면 cache_fill_finish, -1 이면 cache_fill_abort */
+int cache_fill_disk(cache_fill_t *f);
+ssize_t cache_fill_disk_next(cache_fill_t *f, char **p);
+/* 붙어 있는 follower 가 있는지. leader 의 클라이언트가 끊어도 있으면 끝까지 받아야 함 */
+int cache_fill_shared(cache_fill_t *f);
+
+/* 다 받은 응답을 복사 없이 캐싱. 같은 uri 가 있으면 entry 를 바꿔 끼우고, 없으면 넣은 뒤 byte 한도를 넘은 만큼 정책에 따라 소거.
+   캐싱할 수 없으면 버림. 어느 쪽이든 follower 에게 끝을 알리고 f 는 빈 상태가 됨.
+   304 로 재검증했으면 캐시의 응답을 참조를 잡아서 돌려줌: leader 는 그것을 클라이언트에 보낸 뒤 cache_release. 아니면 NULL */
+cache_entry_t *cache_fill_finish(cache_fill_t *f);
+/* 중간에 끊긴 응답. 받은 segment 를 버리고 follower 에게 실패를 알림 */
+void cache_fill_abort(cache_fill_t *f);
+/* 웹 서버 실패 (연결 실패, timeout, 읽기 실패). 재검증하던 응답이 stale-if-error 기간이면 (또는 이미 304 를 받았으면)
+   follower 에게 그것을 읽게 하고 참조를 잡아서 돌려줌: leader 는 cache_fill_finish 처럼 보내고 cache_release.
+   아니면 cache_fill_abort 하고 NULL */
+cache_entry_t *cache_fill_error(cache_fill_t *f);
+
+/* follower 가 다음에 보낼 수 있는 데이터 (leader 가 304 를 받았으면 캐시의 응답). *p 에 위치를 주고 길이 반환, 응답이 끝났으면 0, leader 가 실패했으면 -1,
+   공유하면 안 되는 응답이면 CACHE_FOLLOW_PASS.
+   아직 새 데이터가 없으면 w 가 NULL 이면 올 때까지 block, 아니면 w 를 등록하고 CACHE_FOLLOW_WAIT */
+ssize_t cache_follow_next(cache_follow_t *fw, char **p, cache_waiter_t *w);
+/* cache_follow_next 로 받은 데이터 중 n byte 를 보냈음 */
+void cache_follow_advance(cache_follow_t *fw, size_t n);
+void cache_follow_release(cache_follow_t *fw);
+
+#endif /* __CACHE_H__ */
@@ -0,0 +1,78 @@
+/*
+    co.h - stackless coroutine (switch 문 기반, Duff's device / protothreads 방식)
+
+    함수 하나를 coroutine 으로 쓰려면 본문을 CO_BEGIN / CO_END 로 감싸고,
+    기다려야 하는 곳에서 CO_YIELD / CO_AWAIT / CO_AWAIT_IO 를 씀.
+    다시 호출하면 마지막으로 멈춘 곳 바로 다음 줄부터 이어서 실행됨.
+
+    - 멈춘 위치(줄 번호) 하나만 co_t 에 저장하므로 coroutine 하나의 크기는 int 몇 개.
+      대신 yield 를 넘어 살아있어야 하는 값은 지역 변수가 아니라 호출하는 쪽 구조체(frame)에 둘 것.
+    - CO_YIELD 계열 매크로는 한 줄에 하나만 (줄 번호를 case label 로 씀).
+    - 다른 쪽에서 co->cancelled = 1 로 두고 다시 호출하면 멈췄던 곳에서 CO_CANCELLED 위치로 점프함
+      (timeout 처리용). CO_CANCELLED 를 쓰지 않는 coroutine 은 cancelled 를 켜면 안 됨.
+*/
+#ifndef __CO_H__
+#define __CO_H__
+
+#include <errno.h>
+
+#define CO_WAIT 0  // 멈춤. 이벤트가 오면 다시 호출
+#define CO_DONE -1 // 끝남
+
+typedef struct
+{
+  int line;      // 다음에 이어서 실행할 위치. 0 이면 처음, -1 이면 끝남
+  int cancelled; // 다음 재개 때 CO_CANCELLED 로 점프
+} co_t;
+
+#define CO_INIT(co) ((co)->line = 0, (co)->cancelled = 0)
+
+#define CO_BEGIN(co)    \
+  switch ((co)->line)   \
+  {                     \
+  case 0:
+
+#define CO_END(co)      \
+  }                     \
+  (co)->line = -1;      \
+  return CO_DONE;
+
+/* 여기서 멈추고 호출한 쪽으로 CO_WAIT 반환 */
+#define CO_YIELD(co)              \
+  do                              \
+  {                               \
+    (co)->line = __LINE__;        \
+    return CO_WAIT;               \
+  case __LINE__:                  \
+    if ((co)->cancelled)          \
+      goto co_cancelled;          \
+  } while (0)
+
+/* coroutine 종료 */
+#define CO_EXIT(co)      \
+  do                     \
+  {                      \
+    (co)->line = -1;     \
+    return CO_DONE;      \
+  } while (0)
+
+/* cond 가 참이 될 때까지 멈춤 (재개될 때마다 다시 평가) */
+#define CO_AWAIT(co, cond) \
+  while (!(cond))          \
+  CO_YIELD(co)
+
+/* non-blocking 시스템 콜 expr 을 EAGAIN 이 아닐 때까지 반복. 결과는 n 에 */
+#define CO_AWAIT_IO(co, n, expr)                                                    \
+  do                                                                                \
+  {                                                                                 \
+    while (((n) = (expr)) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) \
+      if (errno != EINTR)                                                           \
+        CO_YIELD(co);                                                               \
+  } while (0)
+
+/* cancel 되었을 때 실행할 부분의 시작. 정상 흐름이 여기로 떨어지지 않도록 앞에 CO_EXIT 를 둘 것 */
+#define CO_CANCELLED(co) \
+  co_cancelled:          \
+  (co)->cancelled = 0
+
+#endif /* __CO_H__ */
@@ -1,6 +1,10 @@
 /* 
  * csapp.c - Functions for the CS:APP3e book
  *
+ * Updated 10/2026:
+ *   - Rio, Accept, Close and open_clientfd can run on a per-thread
+ *     io_uring (rio_set_backend)
+ *
  * Updated 10/2016 reb:
  *   - Fixed bug in sio_ltoa that didn't cover negative numbers
  *
@@ -314,6 +318,458 @@ void Sio_error(char s[])
     sio_error(s);
 }
 
+/*************************************************
+ * io_uring backend for the Rio package
+ *
+ * After rio_set_backend(RIO_BACKEND_URING), the Rio functions and the
+ * Accept, Close and open_clientfd helpers submit their I/O through a
+ * per-thread io_uring instead of calling read(), write(), accept(),
+ * connect() and close() directly:
+ *   - rio_writen copies the data into a registered buffer and only
+ *     queues a WRITE_FIXED. It is submitted together with the thread's
+ *     next read, accept, connect or close, so a relay loop costs one
+ *     io_uring_enter() per (write, read) pair.
+ *   - Descriptors are installed in the ring's sparse fixed-file table
+ *     the first time they are used (an IORING_OP_FILES_UPDATE linked in
+ *     front of the op) and removed again by Close.
+ * Only one write is in flight per thread, so bytes written to a socket
+ * stay in order and short writes are resubmitted from the same buffer.
+ * Callers must end every connection with Close, which also flushes
+ * the deferred write.
+ *************************************************/
+/* $begin rio_uring */
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES  64      /* SQ entries per thread */
+#define URING_WBUFSIZE 65536   /* Registered write buffer per thread */
+#define URING_FILES    4096    /* Fixed-file slots, indexed by fd */
+#define URING_NO_WAIT  (~0ULL) /* user_data nobody waits for */
+
+typedef struct {
+    int ring_fd;
+    unsigned sq_entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+    unsigned long long seq;          /* Last user_data handed out */
+
+    char *wbuf;                      /* Registered write buffer */
+    unsigned long long wseq;         /* user_data of the in-flight write, 0 if none */
+    int wfd;                         /* In-flight write: descriptor */
+    size_t wlen, wdone;              /* ... length and bytes completed */
+    int werr;                        /* errno of a failed deferred write */
+
+    int nfiles;                      /* Fixed-file slots, 0 if unsupported */
+    int files[URING_FILES];          /* files[fd] == fd, source for FILES_UPDATE */
+    unsigned char fixed[URING_FILES];/* fd is installed in the fixed table */
+} uring_t;
+
+static int rio_backend_type = RIO_BACKEND_SYSCALL;
+static const int uring_unset = -1;   /* FILES_UPDATE source that clears a slot */
+static pthread_key_t uring_key;
+static pthread_once_t uring_once = PTHREAD_ONCE_INIT;
+static __thread uring_t *uring_self;
+
+static void uring_free(void *arg);
+
+static void uring_key_init(void)
+{
+    pthread_key_create(&uring_key, uring_free);
+}
+
+/* uring_create - Set up a ring, its registered buffer and fixed-file table */
+static uring_t *uring_create(void)
+{
+    struct io_uring_params p;
+    struct iovec iov;
+    uring_t *u;
+    int i;
+
+    if ((u = calloc(1, sizeof(uring_t))) == NULL)
+	return NULL;
+    memset(&p, 0, sizeof(p));
+    if ((u->ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0) {
+	free(u);
+	return NULL;
+    }
+
+    u->sq_entries = p.sq_entries;
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (u->cq_len > u->sq_len)
+	    u->sq_len = u->cq_len;
+	u->cq_len = u->sq_len;
+    }
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE,
+		     MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED)
+	goto fail;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+	u->cq_ptr = u->sq_ptr;
+    else if ((u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE,
+			       MAP_SHARED | MAP_POPULATE, u->ring_fd,
+			       IORING_OFF_CQ_RING)) == MAP_FAILED)
+	goto fail;
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    if ((u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, u->ring_fd,
+			IORING_OFF_SQES)) == MAP_FAILED)
+	goto fail;
+
+    u->sq_head = (unsigned *)((char *)u->sq_ptr + p.sq_off.head);
+    u->sq_tail = (unsigned *)((char *)u->sq_ptr + p.sq_off.tail);
+    u->sq_mask = (unsigned *)((char *)u->sq_ptr + p.sq_off.ring_mask);
+    u->sq_array = (unsigned *)((char *)u->sq_ptr + p.sq_off.array);
+    u->cq_head = (unsigned *)((char *)u->cq_ptr + p.cq_off.head);
+    u->cq_tail = (unsigned *)((char *)u->cq_ptr + p.cq_off.tail);
+    u->cq_mask = (unsigned *)((char *)u->cq_ptr + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ptr + p.cq_off.cqes);
+
+    /* One registered buffer backs every deferred write of this thread */
+    if ((u->wbuf = malloc(URING_WBUFSIZE)) == NULL)
+	goto fail;
+    iov.iov_base = u->wbuf;
+    iov.iov_len = URING_WBUFSIZE;
+    if (syscall(__NR_io_uring_register, u->ring_fd,
+		IORING_REGISTER_BUFFERS, &iov, 1) < 0)
+	goto fail;
+
+    /* A sparse fixed-file table; without it we fall back to plain fds */
+    for (i = 0; i < URING_FILES; i++)
+	u->files[i] = -1;
+    if (syscall(__NR_io_uring_register, u->ring_fd,
+		IORING_REGISTER_FILES, u->files, URING_FILES) == 0)
+	u->nfiles = URING_FILES;
+    for (i = 0; i < URING_FILES; i++)
+	u->files[i] = i;
+    return u;
+
+ fail:
+    uring_free(u);
+    return NULL;
+}
+
+/* uring_get - Return the calling thread's ring, creating it on first use */
+static uring_t *uring_get(void)
+{
+    if (uring_self == NULL) {
+	pthread_once(&uring_once, uring_key_init);
+	if ((uring_self = uring_create()) == NULL)
+	    unix_error("io_uring setup error");
+	pthread_setspecific(uring_key, uring_self);
+    }
+    return uring_self;
+}
+
+/* uring_enter - Submit every queued SQE and wait for min_complete CQEs */
+static int uring_enter(uring_t *u, unsigned min_complete)
+{
+    unsigned pending;
+    int rc;
+
+    do {
+	pending = *u->sq_tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+	rc = syscall(__NR_io_uring_enter, u->ring_fd, pending, min_complete,
+		     min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (rc < 0 && errno == EINTR);
+    return rc;
+}
+
+/* uring_sqe - Queue a zeroed SQE (the ring is not SQPOLL, so the kernel
+ * only looks at it on the next io_uring_enter) */
+static struct io_uring_sqe *uring_sqe(uring_t *u, unsigned long long user_data)
+{
+    unsigned tail = *u->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE) == u->sq_entries)
+	uring_enter(u, 0);  /* SQ full: submit what we have */
+    sqe = &u->sqes[tail & *u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    u->sq_array[tail & *u->sq_mask] = tail & *u->sq_mask;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+/* uring_file - Return the fixed-file index for fd, installing it first
+ * if needed, and add IOSQE_FIXED_FILE to *flags. Plain fd otherwise. */
+static int uring_file(uring_t *u, int fd, unsigned char *flags)
+{
+    struct io_uring_sqe *sqe;
+
+    if (fd < 0 || fd >= u->nfiles)
+	return fd;
+    if (!u->fixed[fd]) {
+	sqe = uring_sqe(u, 0);
+	sqe->opcode = IORING_OP_FILES_UPDATE;
+	sqe->fd = -1;
+	sqe->addr = (unsigned long)&u->files[fd];
+	sqe->len = 1;
+	sqe->off = fd;
+	sqe->flags = IOSQE_IO_LINK;  /* Must land before the op it precedes */
+	u->fixed[fd] = 1;
+    }
+    *flags |= IOSQE_FIXED_FILE;
+    return fd;
+}
+
+/* uring_write_submit - Queue the rest of the in-flight write */
+static void uring_write_submit(uring_t *u)
+{
+    struct io_uring_sqe *sqe;
+    unsigned char flags = 0;
+    int fd = uring_file(u, u->wfd, &flags);
+
+    u->wseq = ++u->seq;
+    sqe = uring_sqe(u, u->wseq);
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)(u->wbuf + u->wdone);
+    sqe->len = u->wlen - u->wdone;
+    sqe->buf_index = 0;
+}
+
+/* uring_write_done - Completion of the in-flight write */
+static void uring_write_done(uring_t *u, int res)
+{
+    u->wseq = 0;
+    if (res <= 0) {
+	u->werr = res < 0 ? -res : EPIPE;
+	return;
+    }
+    u->wdone += res;
+    if (u->wdone < u->wlen)  /* Short write: continue from the same buffer */
+	uring_write_submit(u);
+}
+
+/* uring_reap - Consume available CQEs; return 1 and *res if want showed up */
+static int uring_reap(uring_t *u, unsigned long long want, int *res)
+{
+    unsigned head = *u->cq_head;
+    int found = 0;
+
+    while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+	struct io_uring_cqe *cqe = &u->cqes[head & *u->cq_mask];
+	head++;
+	if (cqe->user_data == want) {
+	    found = 1;
+	    *res = cqe->res;
+	}
+	else if (u->wseq && cqe->user_data == u->wseq)
+	    uring_write_done(u, cqe->res);
+	/* user_data 0: fire-and-forget FILES_UPDATE */
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+    return found;
+}
+
+/* uring_wait - Submit and wait for the op tagged user_data; return its res */
+static int uring_wait(uring_t *u, unsigned long long user_data)
+{
+    int res;
+
+    while (!uring_reap(u, user_data, &res))
+	if (uring_enter(u, 1) < 0)
+	    return -errno;
+    return res;
+}
+
+/* uring_write_flush - Wait for the in-flight write; report its error */
+static int uring_write_flush(uring_t *u)
+{
+    int res;
+
+    while (u->wseq) {
+	if (uring_reap(u, URING_NO_WAIT, &res))
+	    continue;
+	if (u->wseq && uring_enter(u, 1) < 0)
+	    return -1;
+    }
+    if (u->werr) {
+	errno = u->werr;
+	u->werr = 0;
+	return -1;
+    }
+    return 0;
+}
+
+static void uring_free(void *arg)
+{
+    uring_t *u = arg;
+
+    if (u == NULL)
+	return;
+    if (u->sqes != NULL && u->sqes != MAP_FAILED)
+	uring_write_flush(u);
+    if (u->sqes != NULL && u->sqes != MAP_FAILED)
+	munmap(u->sqes, u->sqes_len);
+    if (u->cq_ptr != NULL && u->cq_ptr != MAP_FAILED && u->cq_ptr != u->sq_ptr)
+	munmap(u->cq_ptr, u->cq_len);
+    if (u->sq_ptr != NULL && u->sq_ptr != MAP_FAILED)
+	munmap(u->sq_ptr, u->sq_len);
+    close(u->ring_fd);
+    free(u->wbuf);
+    free(u);
+}
+
+/* uring_op - Queue a single op on fd and wait for it */
+static ssize_t uring_op(int opcode, int fd, int fixed, void *addr,
+			unsigned len, unsigned long long off)
+{
+    uring_t *u = uring_get();
+    struct io_uring_sqe *sqe;
+    unsigned long long user_data;
+    unsigned char flags = 0;
+    int res;
+
+    if (fixed)
+	fd = uring_file(u, fd, &flags);
+    user_data = ++u->seq;
+    sqe = uring_sqe(u, user_data);
+    sqe->opcode = opcode;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)addr;
+    sqe->len = len;
+    sqe->off = off;
+    if ((res = uring_wait(u, user_data)) < 0) {
+	errno = -res;
+	return -1;
+    }
+    return res;
+}
+
+static ssize_t uring_read(int fd, void *buf, size_t n)
+{
+    return uring_op(IORING_OP_READ, fd, 1, buf, n, (unsigned long long)-1);
+}
+
+/* uring_writen - Copy usrbuf into the registered buffer and defer the write */
+static ssize_t uring_writen(int fd, void *usrbuf, size_t n)
+{
+    uring_t *u = uring_get();
+    char *bufp = usrbuf;
+    size_t nleft = n, len;
+
+    while (nleft > 0) {
+	if (uring_write_flush(u) < 0)
+	    return -1;
+	len = nleft < URING_WBUFSIZE ? nleft : URING_WBUFSIZE;
+	memcpy(u->wbuf, bufp, len);
+	u->wfd = fd;
+	u->wlen = len;
+	u->wdone = 0;
+	uring_write_submit(u);
+	nleft -= len;
+	bufp += len;
+    }
+    return n;
+}
+
+static int uring_accept(int s, struct sockaddr *addr, socklen_t *addrlen)
+{
+    uring_t *u = uring_get();
+    struct io_uring_sqe *sqe;
+    unsigned long long user_data;
+    unsigned char flags = 0;
+    int fd, res;
+
+    fd = uring_file(u, s, &flags);
+    user_data = ++u->seq;
+    sqe = uring_sqe(u, user_data);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->flags = flags;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)addr;
+    sqe->addr2 = (unsigned long)addrlen;
+    if ((res = uring_wait(u, user_data)) < 0) {
+	errno = -res;
+	return -1;
+    }
+    return res;
+}
+
+/* Not a fixed file: open_clientfd closes failed sockets with close() */
+static int uring_connect(int fd, struct sockaddr *addr, socklen_t addrlen)
+{
+    return uring_op(IORING_OP_CONNECT, fd, 0, addr, 0, addrlen) < 0 ? -1 : 0;
+}
+
+/* uring_close - Drop fd from the fixed table and close it, in one enter */
+static int uring_close(int fd)
+{
+    uring_t *u = uring_get();
+    struct io_uring_sqe *sqe;
+    int err = 0;
+
+    if (u->wseq && u->wfd == fd && uring_write_flush(u) < 0)
+	err = errno;  /* Like close(), only report it if close fails too */
+    if (fd >= 0 && fd < u->nfiles && u->fixed[fd]) {
+	sqe = uring_sqe(u, 0);
+	sqe->opcode = IORING_OP_FILES_UPDATE;
+	sqe->fd = -1;
+	sqe->addr = (unsigned long)&uring_unset;
+	sqe->len = 1;
+	sqe->off = fd;
+	u->fixed[fd] = 0;
+    }
+    if (uring_op(IORING_OP_CLOSE, fd, 0, NULL, 0, 0) < 0) {
+	if (err)
+	    errno = err;
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * rio_set_backend - Select how the Rio package does I/O. The io_uring
+ *     backend is tried on the calling thread first; returns -1 (and
+ *     keeps the current backend) if the kernel does not support it.
+ */
+int rio_set_backend(int backend)
+{
+    if (backend == RIO_BACKEND_URING && uring_self == NULL) {
+	pthread_once(&uring_once, uring_key_init);
+	if ((uring_self = uring_create()) == NULL)
+	    return -1;
+	pthread_setspecific(uring_key, uring_self);
+    }
+    rio_backend_type = backend;
+    return 0;
+}
+
+int rio_get_backend(void)
+{
+    return rio_backend_type;
+}
+
+/*
+ * rio_flush - Push out the deferred rio_writen and wait for it. Needed
+ *     before waiting on the peer with anything other than Rio (poll,
+ *     read), which would not submit it. No-op for the syscall backend.
+ */
+int rio_flush(void)
+{
+    if (rio_backend_type == RIO_BACKEND_URING && uring_self != NULL)
+	return uring_write_flush(uring_self);
+    return 0;
+}
+
+static ssize_t rio_sys_read(int fd, void *buf, size_t n)
+{
+    if (rio_backend_type == RIO_BACKEND_URING)
+	return uring_read(fd, buf, n);
+    return read(fd, buf, n);
+}
+/* $end rio_uring */
+
 /********************************
  * Wrappers for Unix I/O routines
  ********************************/
@@ -358,7 +814,11 @@ void Close(int fd)
 {
     int rc;
 
-    if ((rc = close(fd)) < 0)
+    if (rio_backend_type == RIO_BACKEND_URING)
+	rc = uring_close(fd);
+    else
+	rc = close(fd);
+    if (rc < 0)
 	unix_error("Close error");
 }
 
@@ -582,7 +1042,11 @@ int Accept(int s, struct sockaddr *addr, socklen_t *addrlen)
 {
     int rc;
 
-    if ((rc = accept(s, addr, addrlen)) < 0)
+    if (rio_backend_type == RIO_BACKEND_URING)
+	rc = uring_accept(s, addr, addrlen);
+    else
+	rc = accept(s, addr, addrlen);
+    if (rc < 0)
 	unix_error("Accept error");
     return rc;
 }
@@ -753,7 +1217,7 @@ ssize_t rio_readn(int fd, void *usrbuf, size_t n)
     char *bufp = usrbuf;
 
     while (nleft > 0) {
-	if ((nread = read(fd, bufp, nleft)) < 0) {
+	if ((nread = rio_sys_read(fd, bufp, nleft)) < 0) {
 	    if (errno == EINTR) /* Interrupted by sig handler return */
 		nread = 0;      /* and call read() again */
 	    else
@@ -778,6 +1242,9 @@ ssize_t rio_writen(int fd, void *usrbuf, size_t n)
     ssize_t nwritten;
     char *bufp = usrbuf;
 
+    if (rio_backend_type == RIO_BACKEND_URING)
+	return uring_writen(fd, usrbuf, n);
+
     while (nleft > 0) {
 	if ((nwritten = write(fd, bufp, nleft)) <= 0) {
 	    if (errno == EINTR)  /* Interrupted by sig handler return */
@@ -807,8 +1274,8 @@ static ssize_t rio_read(rio_t *rp, char *usrbuf, size_t n)
     int cnt;
 
     while (rp->rio_cnt <= 0) {  /* Refill if buf is empty */
-	rp->rio_cnt = read(rp->rio_fd, rp->rio_buf, 
-			   sizeof(rp->rio_buf));
+	rp->rio_cnt = rio_sys_read(rp->rio_fd, rp->rio_buf, 
+				   sizeof(rp->rio_buf));
 	if (rp->rio_cnt < 0) {
 	    if (errno != EINTR) /* Interrupted by sig handler return */
 		return -1;
@@ -968,7 +1435,11 @@ int open_clientfd(char *hostname, char *port) {
             continue; /* Socket failed, try the next */
 
         /* Connect to the server */
-        if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
+        if (rio_backend_type == RIO_BACKEND_URING) {
+            if (uring_connect(clientfd, p->ai_addr, p->ai_addrlen) != -1)
+                break; /* Success */
+        }
+        else if (connect(clientfd, p->ai_addr, p->ai_addrlen) != -1) 
             break; /* Success */
         if (close(clientfd) < 0) { /* Connect failed, try another */  //line:netp:openclientfd:closefd
             fprintf(stderr, "open_clientfd: close failed: %s\n", strerror(errno));
@@ -994,7 +1465,7 @@ int open_clientfd(char *hostname, char *port) {
  *       -1 with errno set for other errors.
  */
 /* $begin open_listenfd */
-int open_listenfd(char *port) 
+static int open_listenfd_opt(char *port, int reuseport)
 {
     struct addrinfo hints, *listp, *p;
     int listenfd, rc, optval=1;
@@ -1019,6 +1490,11 @@ int open_listenfd(char *port)
         setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR,    //line:netp:csapp:setsockopt
                    (const void *)&optval , sizeof(int));
 
+        /* Several sockets share the port; the kernel spreads connections */
+        if (reuseport)
+            setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT,
+                       (const void *)&optval , sizeof(int));
+
         /* Bind the descriptor to the address */
         if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0)
             break; /* Success */
@@ -1041,8 +1517,23 @@ int open_listenfd(char *port)
     }
     return listenfd;
 }
+
+int open_listenfd(char *port) 
+{
+    return open_listenfd_opt(port, 0);
+}
 /* $end open_listenfd */
 
+/*
+ * open_listenfd_reuseport - Like open_listenfd, but with SO_REUSEPORT
+ *     set so that each thread can own a listening socket on the same
+ *     port and the kernel load-balances incoming connections.
+ */
+int open_listenfd_reuseport(char *port)
+{
+    return open_listenfd_opt(port, 1);
+}
+
 /****************************************************
  * Wrappers for reentrant protocol-independent helpers
  ****************************************************/
@@ -1064,6 +1555,15 @@ int Open_listenfd(char *port)
     return rc;
 }
 
+int Open_listenfd_reuseport(char *port)
+{
+    int rc;
+
+    if ((rc = open_listenfd_reuseport(port)) < 0)
+	unix_error("Open_listenfd_reuseport error");
+    return rc;
+}
+
 /* $end csapp.c */
 
 
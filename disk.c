@@ -0,0 +1,253 @@
+/*
+    disk.c - 메모리 캐시에서 소거된 응답을 받아 두는 디스크 tier (log 구조 저장소 + mmap 한 index)
+*/
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csapp.h"
+#include "disk.h"
+
+#define DISK_MAGIC 0x6b736964       // 기록 머리 ("disk")
+#define DISK_IDX_MAGIC 0x7864696b736964ULL // index 파일 머리 ("diskidx")
+#define DISK_IOV_MAX 64
+
+/* log 의 기록 하나. 바로 뒤에 uri, 그 뒤에 응답 (헤더 + 본문) len byte */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t uri_len;
+  uint64_t hash;
+  uint64_t len;
+  int64_t expires; // 만료 시각 (CLOCK_REALTIME ms). 재시작해도 그대로 씀
+} disk_rec_t;
+
+/* index 파일 머리. 바로 뒤에 slot nslots 개 */
+typedef struct
+{
+  uint64_t magic;
+  uint64_t nslots;   // 2의 거듭제곱
+  uint64_t log_size;
+  uint64_t head;     // 다음 기록을 쓸 논리 offset. 쓰기 전에 자리를 잡으면서 늘림
+} disk_idx_hdr_t;
+
+typedef struct
+{
+  uint64_t hash;
+  uint64_t rec;      // 기록 번호 (논리 offset + 1). 0 이면 빈 slot
+} disk_slot_t;
+
+static pthread_mutex_t disk_lock = PTHREAD_MUTEX_INITIALIZER; // index 와 head
+static int log_fd = -1;
+static uint64_t log_size;
+static disk_idx_hdr_t *idx;
+static disk_slot_t *slots;
+
+static long long real_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/* 기록 번호 rec 이 아직 덮어쓰이지 않았는지. disk_lock 을 잡은 상태에서 호출.
+   head 에 자리를 잡은 기록은 논리 offset 이 head - log_size 보다 앞인 기록을 (쓰기 전에) 덮어씀 */
+static int rec_live(uint64_t rec)
+{
+  return rec != 0 && rec - 1 + log_size >= idx->head;
+}
+
+int disk_open(const char *path, size_t bytes)
+{
+  char idx_path[MAXLINE];
+  disk_idx_hdr_t hdr;
+  uint64_t nslots = 1024;
+  size_t idx_bytes;
+  int fd;
+
+  while (nslots < bytes / DISK_AVG_OBJECT * 2)
+    nslots <<= 1;
+  idx_bytes = sizeof(disk_idx_hdr_t) + nslots * sizeof(disk_slot_t);
+
+  if ((log_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+    return -1;
+  snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+  if (ftruncate(log_fd, bytes) < 0 || (fd = open(idx_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+  {
+    close(log_fd);
+    log_fd = -1;
+    return -1;
+  }
+
+  /* 같은 크기로 쓰던 index 면 그대로 이어 씀. 아니면 빈 파일 (0 으로 채운 sparse 파일) 로 새로 만듦 */
+  if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+      hdr.magic != DISK_IDX_MAGIC || hdr.nslots != nslots || hdr.log_size != bytes)
+  {
+    hdr.magic = 0;
+    if (ftruncate(fd, 0) < 0)
+      goto fail;
+  }
+  if (ftruncate(fd, idx_bytes) < 0)
+    goto fail;
+  if ((idx = mmap(NULL, idx_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    goto fail;
+  close(fd);
+  if (hdr.magic == 0)
+  {
+    idx->nslots = nslots;
+    idx->log_size = bytes;
+    idx->head = 0;
+    idx->magic = DISK_IDX_MAGIC;
+  }
+  slots = (disk_slot_t *)(idx + 1);
+  log_size = bytes;
+  return 0;
+
+fail:
+  close(fd);
+  close(log_fd);
+  log_fd = -1;
+  idx = NULL;
+  return -1;
+}
+
+int disk_enabled(void)
+{
+  return log_fd >= 0;
+}
+
+/* hash 의 slot 을 차례로 찾아봄. 같은 hash 의 slot 이 있으면 그것, 없으면 처음 만난 빈 (또는 덮어쓰인 기록의) slot,
+   그것도 없으면 NULL. disk_lock 을 잡은 상태에서 호출 */
+static disk_slot_t *find_slot(uint64_t hash, disk_slot_t **free_slot)
+{
+  *free_slot = NULL;
+  for (uint64_t i = 0; i < DISK_PROBES; i++)
+  {
+    disk_slot_t *s = &slots[(hash + i) & (idx->nslots - 1)];
+
+    if (s->rec != 0 && s->hash == hash)
+      return s;
+    if (*free_slot == NULL && !rec_live(s->rec))
+      *free_slot = s;
+  }
+  return NULL;
+}
+
+uint64_t disk_put(uint64_t hash, const char *uri, const struct iovec *iov, int iovcnt, size_t len, long long ttl_ms)
+{
+  struct iovec v[DISK_IOV_MAX];
+  disk_rec_t rec;
+  disk_slot_t *s, *free_slot;
+  uint64_t at, reclen;
+
+  rec.magic = DISK_MAGIC;
+  rec.uri_len = strlen(uri);
+  rec.hash = hash;
+  rec.len = len;
+  rec.expires = real_ms() + ttl_ms;
+  reclen = sizeof(rec) + rec.uri_len + len;
+  if (log_fd < 0 || reclen > log_size || iovcnt + 2 > DISK_IOV_MAX)
+    return 0;
+  v[0].iov_base = &rec;
+  v[0].iov_len = sizeof(rec);
+  v[1].iov_base = (char *)uri;
+  v[1].iov_len = rec.uri_len;
+  memcpy(v + 2, iov, iovcnt * sizeof(struct iovec));
+
+  /* 자리부터 잡음. 파일 끝을 넘는 기록은 두지 않고 처음으로 돌아감 */
+  pthread_mutex_lock(&disk_lock);
+  at = idx->head;
+  if (at % log_size + reclen > log_size)
+    at += log_size - at % log_size;
+  idx->head = at + reclen;
+  pthread_mutex_unlock(&disk_lock);
+
+  if (pwritev(log_fd, v, iovcnt + 2, at % log_size) != (ssize_t)reclen)
+    return 0;
+
+  /* 쓰는 사이에 다른 기록이 한 바퀴 돌아 덮어썼으면 index 에 넣지 않음. slot 이 모자라면 첫 slot 을 덮어씀 */
+  pthread_mutex_lock(&disk_lock);
+  if (rec_live(at + 1))
+  {
+    if ((s = find_slot(hash, &free_slot)) == NULL)
+      s = free_slot != NULL ? free_slot : &slots[hash & (idx->nslots - 1)];
+    s->hash = hash;
+    s->rec = at + 1;
+  }
+  pthread_mutex_unlock(&disk_lock);
+  return at + 1;
+}
+
+int disk_get(uint64_t hash, const char *uri, disk_obj_t *o)
+{
+  char buf[sizeof(disk_rec_t) + MAXLINE];
+  size_t uri_len = strlen(uri);
+  disk_slot_t *s, *free_slot;
+  disk_rec_t rec;
+  uint64_t r = 0;
+  off_t at;
+
+  if (log_fd < 0 || uri_len >= MAXLINE)
+    return 0;
+  pthread_mutex_lock(&disk_lock);
+  if ((s = find_slot(hash, &free_slot)) != NULL && rec_live(s->rec))
+    r = s->rec;
+  pthread_mutex_unlock(&disk_lock);
+  if (r == 0)
+    return 0;
+
+  /* 기록 머리와 uri 를 한 번에 읽어서 hash 충돌이나 덮어쓰는 중인 기록을 걸러 냄 */
+  at = (r - 1) % log_size;
+  if (pread(log_fd, buf, sizeof(rec) + uri_len, at) != (ssize_t)(sizeof(rec) + uri_len))
+    return 0;
+  memcpy(&rec, buf, sizeof(rec));
+  if (rec.magic != DISK_MAGIC || rec.hash != hash || rec.uri_len != uri_len || memcmp(buf + sizeof(rec), uri, uri_len))
+    return 0;
+  if ((o->ttl_ms = rec.expires - real_ms()) <= 0)
+    return 0;
+  o->rec = r;
+  o->off = at + sizeof(rec) + uri_len;
+  o->len = rec.len;
+  o->pos = 0;
+  return disk_live(r);
+}
+
+ssize_t disk_read(disk_obj_t *o, char *buf, size_t size)
+{
+  ssize_t n;
+
+  if (o->pos == o->len)
+    return 0;
+  if (size > o->len - o->pos)
+    size = o->len - o->pos;
+  while ((n = pread(log_fd, buf, size, o->off + o->pos)) < 0 && errno == EINTR)
+    ;
+  if (n <= 0 || !disk_live(o->rec)) // 읽는 사이에 덮어썼을 수 있음
+    return -1;
+  o->pos += n;
+  return n;
+}
+
+void disk_forget(uint64_t hash)
+{
+  disk_slot_t *s, *free_slot;
+
+  if (log_fd < 0)
+    return;
+  pthread_mutex_lock(&disk_lock);
+  if ((s = find_slot(hash, &free_slot)) != NULL)
+    s->rec = 0;
+  pthread_mutex_unlock(&disk_lock);
+}
+
+int disk_live(uint64_t rec)
+{
+  int live;
+
+  if (log_fd < 0)
+    return 0;
+  pthread_mutex_lock(&disk_lock);
+  live = rec_live(rec);
+  pthread_mutex_unlock(&disk_lock);
+  return live;
+}
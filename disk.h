@@ -0,0 +1,51 @@
+/*
+    disk.h - 메모리 캐시에서 소거된 응답을 받아 두는 디스크 tier (log 구조 저장소 + mmap 한 index)
+
+    - log : 크기가 정해진 파일 하나를 처음부터 끝까지 이어 쓰고, 끝에 닿으면 처음으로 돌아가서 가장 오래된 기록부터 덮어씀.
+            기록마다 위치를 계속 늘어나는 논리 offset 으로 매기므로 (파일 위치 = 논리 offset % log 크기)
+            논리 offset 이 head - log 크기 이상인 기록만 살아 있음. 따로 지우거나 compaction 하지 않음
+    - index : "<path>.idx" 를 mmap 한 open addressing hash table. slot 하나는 uri hash 와 논리 offset (16 byte) 뿐이라
+            객체 수억 개도 index 는 수 GB 이고, 자주 쓰는 부분만 page cache 에 올라옴. log 의 head 도 index 파일 머리에 있어서
+            재시작해도 디스크 tier 를 그대로 이어 씀
+    - 기록마다 uri 와 만료 시각 (CLOCK_REALTIME) 을 같이 두고, 읽을 때 uri 로 hash 충돌을 걸러 내고 만료된 기록은 없는 것으로 봄
+
+    모든 함수는 thread-safe (index 와 head 는 lock 하나로 보호, 파일 I/O 는 lock 밖에서 pread / pwritev)
+*/
+#ifndef __DISK_H__
+#define __DISK_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define DISK_AVG_OBJECT 8192 // index slot 수를 정할 때 가정하는 평균 기록 크기
+#define DISK_PROBES 32       // index 에서 한 hash 로 찾아보는 slot 수
+
+/* 디스크에서 찾은 응답 하나. disk_read 로 차례로 읽음 */
+typedef struct
+{
+  uint64_t rec;        // 기록 번호 (논리 offset + 1)
+  off_t off;           // 응답 (헤더 + 본문) 이 시작하는 파일 위치
+  size_t len;          // 응답 길이
+  size_t pos;          // 지금까지 읽은 byte 수
+  long long ttl_ms;    // 찾았을 때 남은 신선한 기간
+} disk_obj_t;
+
+/* path 에 bytes 크기의 log 파일과 index 파일을 열거나 만듦. 실패하면 -1 */
+int disk_open(const char *path, size_t bytes);
+/* disk_open 했는지 */
+int disk_enabled(void);
+
+/* uri 의 응답을 log 에 이어 씀 (iov 는 헤더 + 본문 len byte). ttl_ms 뒤에 만료. 쓴 기록 번호, 실패하면 0 */
+uint64_t disk_put(uint64_t hash, const char *uri, const struct iovec *iov, int iovcnt, size_t len, long long ttl_ms);
+/* uri 의 응답이 디스크에 있고 아직 신선하면 o 를 채우고 1, 없으면 0 */
+int disk_get(uint64_t hash, const char *uri, disk_obj_t *o);
+/* o 의 다음 byte 들을 buf 에 읽음. 읽은 byte 수, 끝이면 0, 그 사이에 log 가 덮어썼거나 실패하면 -1 */
+ssize_t disk_read(disk_obj_t *o, char *buf, size_t size);
+/* 메모리에 새로 캐싱한 uri. 디스크의 옛 응답을 index 에서 지움 */
+void disk_forget(uint64_t hash);
+/* disk_put 이 돌려준 기록이 아직 덮어쓰이지 않았는지 */
+int disk_live(uint64_t rec);
+
+#endif /* __DISK_H__ */
@@ -0,0 +1,141 @@
+/*
+    epoch.c - epoch 기반 메모리 회수 (EBR)
+*/
+#include <stdatomic.h>
+#include "epoch.h"
+#include "csapp.h"
+
+/* thread 마다 하나. reader 가 쓰는 값은 epoch 하나뿐이고 cache line 을 혼자 차지함 */
+typedef struct epoch_rec
+{
+  _Alignas(EPOCH_CACHELINE) atomic_ulong epoch; // reader 구간 안이면 들어올 때 본 전역 epoch, 밖이면 0
+  atomic_int in_use;                            // 주인 thread 가 있는지. thread 가 끝나면 다른 thread 가 재사용
+  int depth;                                    // epoch_enter 중첩 횟수 (주인 thread 만 씀)
+  struct epoch_rec *next;                       // 전체 record 목록 (추가만 하고 빼지 않음)
+} epoch_rec_t;
+
+/* 회수를 기다리는 메모리 */
+typedef struct garbage
+{
+  void *p;
+  void (*fn)(void *);
+  unsigned long epoch; // 버려질 때의 전역 epoch
+  struct garbage *next;
+} garbage_t;
+
+static _Alignas(EPOCH_CACHELINE) atomic_ulong global_epoch = 1; // 0 은 "reader 구간 밖" 으로 씀
+static _Atomic(epoch_rec_t *) recs;
+static pthread_mutex_t garbage_lock = PTHREAD_MUTEX_INITIALIZER; // garbage 목록과 epoch 증가 (writer 끼리만)
+static garbage_t *garbage;
+
+static pthread_key_t rec_key;
+static pthread_once_t rec_once = PTHREAD_ONCE_INIT;
+static __thread epoch_rec_t *rec_self;
+
+/* thread 가 끝날 때 record 를 돌려놓음 */
+static void rec_release(void *arg)
+{
+  epoch_rec_t *r = arg;
+
+  atomic_store_explicit(&r->epoch, 0, memory_order_release);
+  atomic_store_explicit(&r->in_use, 0, memory_order_release);
+}
+
+static void rec_key_init(void)
+{
+  pthread_key_create(&rec_key, rec_release);
+}
+
+/* 이 thread 의 record. 처음 부를 때 쉬는 record 를 차지하거나 새로 만듦 */
+static epoch_rec_t *rec_get(void)
+{
+  epoch_rec_t *r;
+
+  if (rec_self)
+    return rec_self;
+  pthread_once(&rec_once, rec_key_init);
+
+  for (r = atomic_load(&recs); r; r = r->next)
+  {
+    int unused = 0;
+    if (atomic_compare_exchange_strong(&r->in_use, &unused, 1))
+      break;
+  }
+  if (r == NULL)
+  {
+    if (posix_memalign((void **)&r, EPOCH_CACHELINE, sizeof(epoch_rec_t)) != 0)
+      unix_error("epoch record error");
+    atomic_init(&r->epoch, 0);
+    atomic_init(&r->in_use, 1);
+    r->next = atomic_load(&recs);
+    while (!atomic_compare_exchange_weak(&recs, &r->next, r))
+      ;
+  }
+  r->depth = 0;
+  pthread_setspecific(rec_key, r);
+  return rec_self = r;
+}
+
+void epoch_enter(void)
+{
+  epoch_rec_t *r = rec_get();
+
+  if (r->depth++ > 0)
+    return;
+  atomic_store_explicit(&r->epoch, atomic_load_explicit(&global_epoch, memory_order_relaxed), memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst); // epoch 공개가 이후의 공유 포인터 읽기보다 먼저 보이도록
+}
+
+void epoch_exit(void)
+{
+  epoch_rec_t *r = rec_self;
+
+  if (--r->depth > 0)
+    return;
+  atomic_store_explicit(&r->epoch, 0, memory_order_release);
+}
+
+/* reader 구간 안의 모든 thread 가 현재 epoch 를 봤으면 1 증가. 현재 전역 epoch 반환. garbage_lock 을 잡고 호출 */
+static unsigned long try_advance(void)
+{
+  unsigned long e = atomic_load(&global_epoch);
+
+  for (epoch_rec_t *r = atomic_load(&recs); r; r = r->next)
+  {
+    unsigned long re = atomic_load(&r->epoch);
+    if (re != 0 && re != e)
+      return e;
+  }
+  atomic_store(&global_epoch, e + 1);
+  return e + 1;
+}
+
+void epoch_retire(void *p, void (*fn)(void *))
+{
+  garbage_t *g = Malloc(sizeof(garbage_t)), **pp;
+  unsigned long e;
+
+  g->p = p;
+  g->fn = fn ? fn : free;
+  atomic_thread_fence(memory_order_seq_cst); // 포인터를 바꾼 것이 epoch 를 읽기 전에 보이도록
+  g->epoch = atomic_load(&global_epoch);
+
+  pthread_mutex_lock(&garbage_lock);
+  g->next = garbage;
+  garbage = g;
+  e = try_advance();
+
+  /* 두 epoch 전에 버려진 것은 볼 수 있는 reader 가 없음 */
+  for (pp = &garbage; (g = *pp) != NULL;)
+  {
+    if (g->epoch + 2 <= e)
+    {
+      *pp = g->next;
+      g->fn(g->p);
+      free(g);
+    }
+    else
+      pp = &g->next;
+  }
+  pthread_mutex_unlock(&garbage_lock);
+}
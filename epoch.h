@@ -0,0 +1,23 @@
+/*
+    epoch.h - epoch 기반 메모리 회수 (EBR)
+
+    lock 없이 읽는 쪽 (reader) 이 아직 보고 있을지 모르는 메모리를 바로 free 하지 않고 미뤄 둠.
+    - reader 는 epoch_enter / epoch_exit 사이에서만 공유 포인터를 따라감.
+      자기 thread 전용 record (cache line 하나) 에만 쓰므로 reader 끼리는 같은 cache line 을 건드리지 않음.
+    - writer 는 포인터를 새 값으로 바꾼 뒤 옛 값을 epoch_retire 로 넘김.
+    - 전역 epoch 는 모든 reader 가 현재 epoch 를 본 뒤에만 1 증가하고,
+      epoch e 에 버려진 메모리는 전역 epoch 가 e + 2 가 되면 더 이상 보는 reader 가 없으므로 free.
+*/
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+
+#define EPOCH_CACHELINE 64
+
+/* reader 구간 시작 / 끝. 중첩 가능 */
+void epoch_enter(void);
+void epoch_exit(void);
+
+/* p 를 더 이상 보는 reader 가 없을 때 fn(p) 로 회수. fn 이 NULL 이면 free */
+void epoch_retire(void *p, void (*fn)(void *));
+
+#endif /* __EPOCH_H__ */
@@ -0,0 +1,231 @@
+/*
+    freshness.c - 응답 헤더로 캐싱 여부와 신선한 기간 계산 (RFC 9111)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "freshness.h"
+
+static const char *months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                               "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+time_t http_date(const char *s)
+{
+  struct tm tm;
+  char mon[4];
+  int day, year, hour, min, sec, i;
+
+  if (sscanf(s, "%*[a-zA-Z], %d %3s %d %d:%d:%d GMT", &day, mon, &year, &hour, &min, &sec) != 6 &&  // IMF-fixdate
+      sscanf(s, "%*[a-zA-Z], %d-%3s-%d %d:%d:%d GMT", &day, mon, &year, &hour, &min, &sec) != 6 &&  // RFC 850
+      sscanf(s, "%*[a-zA-Z] %3s %d %d:%d:%d %d", mon, &day, &hour, &min, &sec, &year) != 6)         // asctime
+    return -1;
+  for (i = 0; i < 12 && strcmp(mon, months[i]); i++)
+    ;
+  if (i == 12)
+    return -1;
+  if (year < 100) // RFC 850 의 두 자리 연도
+    year += year < 70 ? 2000 : 1900;
+
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_year = year - 1900;
+  tm.tm_mon = i;
+  tm.tm_mday = day;
+  tm.tm_hour = hour;
+  tm.tm_min = min;
+  tm.tm_sec = sec;
+  return timegm(&tm);
+}
+
+/* delta-seconds. 숫자가 아니면 이미 만료된 것으로 (0) */
+static long delta_seconds(const char *v, size_t len)
+{
+  long n = 0;
+
+  if (len == 0)
+    return 0;
+  for (size_t i = 0; i < len; i++)
+  {
+    if (v[i] < '0' || v[i] > '9')
+      return 0;
+    if (n < 0x7fffffffL / 10)
+      n = n * 10 + v[i] - '0';
+  }
+  return n;
+}
+
+/* Cache-Control: 쉼표로 나뉜 directive. 값은 token 이나 "quoted-string" */
+static void parse_cache_control(const char *v, const char *end, freshness_t *fr)
+{
+  while (v < end)
+  {
+    const char *name, *val = NULL;
+    size_t nlen, vlen = 0;
+
+    while (v < end && (*v == ' ' || *v == '\t' || *v == ','))
+      v++;
+    for (name = v; v < end && *v != ',' && *v != '=' && *v != ' ' && *v != '\t'; v++)
+      ;
+    nlen = v - name;
+    if (v < end && *v == '=')
+    {
+      if (*++v == '"')
+      {
+        for (val = ++v; v < end && *v != '"'; v++)
+          ;
+        vlen = v - val;
+        if (v < end)
+          v++;
+      }
+      else
+      {
+        for (val = v; v < end && *v != ',' && *v != ' ' && *v != '\t'; v++)
+          ;
+        vlen = v - val;
+      }
+    }
+    while (v < end && *v != ',')
+      v++;
+
+#define DIRECTIVE(s) (nlen == sizeof(s) - 1 && !strncasecmp(name, s, nlen))
+    if (DIRECTIVE("no-store"))
+      fr->no_store = 1;
+    else if (DIRECTIVE("no-cache")) // no-cache="field" 도 재검증이 필요한 것으로 봄
+      fr->no_cache = 1;
+    else if (DIRECTIVE("private"))
+      fr->private_ = 1;
+    else if (DIRECTIVE("public"))
+      fr->public_ = 1;
+    else if (DIRECTIVE("max-age"))
+      fr->max_age = delta_seconds(val, vlen);
+    else if (DIRECTIVE("s-maxage"))
+      fr->s_maxage = delta_seconds(val, vlen);
+    else if (DIRECTIVE("stale-while-revalidate"))
+      fr->swr = delta_seconds(val, vlen);
+    else if (DIRECTIVE("stale-if-error"))
+      fr->sie = delta_seconds(val, vlen);
+#undef DIRECTIVE
+  }
+}
+
+/* status line 다음 줄부터 헤더를 읽어서 fr 에 덮어씀. Cache-Control 이 있으면 그 directive 들로 통째로 바꿈 */
+static void parse_fields(const char *hdr, freshness_t *fr)
+{
+  const char *line, *eol;
+  int cache_control = 0;
+
+  for (line = strstr(hdr, "\r\n"); line != NULL && line[2] != '\r' && line[2] != '\0'; line = eol)
+  {
+    const char *name = line + 2, *end, *colon, *v;
+
+    eol = strstr(name, "\r\n");
+    end = eol != NULL ? eol : name + strlen(name);
+    if ((colon = memchr(name, ':', end - name)) == NULL)
+      continue;
+    for (v = colon + 1; v < end && (*v == ' ' || *v == '\t'); v++)
+      ;
+
+#define FIELD(s) (colon - name == sizeof(s) - 1 && !strncasecmp(name, s, colon - name))
+    if (FIELD("Cache-Control"))
+    {
+      if (!cache_control++)
+      {
+        fr->no_store = fr->no_cache = fr->private_ = fr->public_ = 0;
+        fr->max_age = fr->s_maxage = -1;
+        fr->swr = fr->sie = 0;
+      }
+      parse_cache_control(v, end, fr);
+    }
+    else if (FIELD("Expires"))
+    {
+      fr->expires = http_date(v);
+      if (fr->expires < 0)
+        fr->expires = 0;
+    }
+    else if (FIELD("Date"))
+      fr->date = http_date(v);
+    else if (FIELD("Last-Modified"))
+      fr->last_modified = http_date(v);
+    else if (FIELD("Age"))
+      fr->age = atol(v);
+#undef FIELD
+  }
+}
+
+void freshness_parse(const char *hdr, freshness_t *fr)
+{
+  memset(fr, 0, sizeof(*fr));
+  fr->max_age = fr->s_maxage = -1;
+  fr->date = fr->last_modified = fr->expires = -1;
+  if (sscanf(hdr, "HTTP/%*d.%*d %d", &fr->status) != 1)
+    fr->status = 0;
+  parse_fields(hdr, fr);
+}
+
+void freshness_update(const char *hdr, freshness_t *fr)
+{
+  fr->date = -1; // 304 에 Date 가 없으면 지금 받은 것으로 봄
+  fr->age = 0;
+  parse_fields(hdr, fr);
+}
+
+const char *http_field(const char *hdr, size_t len, const char *name, size_t *vlen)
+{
+  const char *end = hdr + len, *line, *eol, *colon, *v;
+  size_t nlen = strlen(name);
+
+  for (line = hdr; line < end; line = eol + 1)
+  {
+    if ((eol = memchr(line, '\n', end - line)) == NULL || eol - line <= 1) // 빈 줄
+      break;
+    if ((colon = memchr(line, ':', eol - line)) == NULL || colon - line != nlen || strncasecmp(line, name, nlen))
+      continue;
+    for (v = colon + 1; v < eol && (*v == ' ' || *v == '\t'); v++)
+      ;
+    for (*vlen = eol - v; *vlen > 0 && (v[*vlen - 1] == '\r' || v[*vlen - 1] == ' ' || v[*vlen - 1] == '\t'); (*vlen)--)
+      ;
+    return v;
+  }
+  return NULL;
+}
+
+/* 신선도 정보가 없어도 heuristic 으로 캐싱할 수 있는 status (RFC 9110 15.1) */
+static int heuristic_status(int status)
+{
+  switch (status)
+  {
+  case 200: case 203: case 204: case 300: case 301: case 308:
+  case 404: case 405: case 410: case 414: case 501:
+    return 1;
+  }
+  return 0;
+}
+
+long freshness_ttl(const freshness_t *fr, time_t now)
+{
+  time_t date = fr->date >= 0 ? fr->date : now;
+  long lifetime, age;
+
+  if (fr->no_store || fr->no_cache || fr->private_ ||
+      fr->status < 200 || fr->status == 206 || fr->status == 304)
+    return 0;
+
+  if (fr->s_maxage >= 0)
+    lifetime = fr->s_maxage;
+  else if (fr->max_age >= 0)
+    lifetime = fr->max_age;
+  else if (fr->expires >= 0)
+    lifetime = fr->expires - date;
+  else if (!heuristic_status(fr->status) && !fr->public_)
+    return 0;
+  else if (fr->last_modified >= 0 && fr->last_modified <= date)
+    lifetime = (date - fr->last_modified) / 10 < FRESH_HEURISTIC_MAX ? (date - fr->last_modified) / 10 : FRESH_HEURISTIC_MAX;
+  else
+    lifetime = FRESH_DEFAULT_TTL;
+
+  /* 받았을 때의 나이. 웹 서버 시계가 앞서 있어도 음수가 되지 않게 */
+  age = now - date > fr->age ? now - date : fr->age;
+  if (age < 0)
+    age = 0;
+  return lifetime - age;
+}
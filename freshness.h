@@ -0,0 +1,45 @@
+/*
+    freshness.h - 응답 헤더로 캐싱 여부와 신선한 기간 계산 (RFC 9111)
+
+    - 저장 가능 : Cache-Control 의 no-store, private (공유 캐시이므로), no-cache (재검증 없이는 쓸 수 없음) 가 없고
+                  status 가 최종 응답. 206 (부분 응답) 과 304 는 저장하지 않음
+    - 신선한 기간 (freshness lifetime) : s-maxage > max-age > Expires - Date 순으로 먼저 있는 것.
+                  셋 다 없으면 heuristic 으로 판단할 수 있는 status (200, 404 등) 만 Last-Modified 로부터 지난 시간의 10%
+                  (FRESH_HEURISTIC_MAX 이하), Last-Modified 도 없으면 FRESH_DEFAULT_TTL
+    - 남은 기간 : 신선한 기간 - 받았을 때 이미 지난 나이 (Age 헤더와 Date 로부터 지난 시간 중 큰 것)
+    - 재검증 : 304 를 받으면 저장해 둔 응답의 헤더에 304 의 헤더를 덮어쓴 것으로 신선한 기간을 다시 계산
+    - 만료 후 (RFC 5861) : stale-while-revalidate 기간에는 만료된 응답을 바로 보내고 뒤에서 갱신,
+                  stale-if-error 기간에는 웹 서버가 실패 (연결 실패, 5xx) 했을 때 만료된 응답을 대신 보냄
+*/
+#ifndef __FRESHNESS_H__
+#define __FRESHNESS_H__
+
+#include <stddef.h>
+#include <time.h>
+
+#define FRESH_DEFAULT_TTL 60       // 신선도 정보가 전혀 없는 응답의 heuristic 기간 (초)
+#define FRESH_HEURISTIC_MAX 86400  // Last-Modified heuristic 의 상한 (초)
+
+typedef struct
+{
+  int status;
+  int no_store, no_cache, private_, public_;
+  long max_age, s_maxage; // 초. 없으면 -1
+  long swr, sie;          // stale-while-revalidate, stale-if-error (RFC 5861, 초). 없으면 0
+  long age;               // Age 헤더 (초). 없으면 0
+  time_t date, last_modified;
+  time_t expires;         // 없으면 -1. 날짜가 아닌 값 ("0" 등) 이면 이미 만료된 것으로 봄 (0)
+} freshness_t;
+
+/* "\r\n\r\n" 까지의 응답 헤더 (status line 포함, '\0' 으로 끝남) 를 읽음 */
+void freshness_parse(const char *hdr, freshness_t *fr);
+/* 재검증 응답 (304) 의 헤더로 저장해 둔 응답의 fr 을 갱신. Cache-Control, Expires, Date, Age 등 304 에 있는 것만 바꿈 */
+void freshness_update(const char *hdr, freshness_t *fr);
+/* now 기준으로 남은 신선한 기간 (초). 저장하면 안 되거나 이미 만료되었으면 0 이하 */
+long freshness_ttl(const freshness_t *fr, time_t now);
+/* HTTP 날짜 (IMF-fixdate, RFC 850, asctime 형식). 잘못된 값이면 -1 */
+time_t http_date(const char *s);
+/* 응답 헤더 hdr (len byte, '\0' 으로 끝나지 않아도 됨) 에서 name 필드의 값 위치. 앞뒤 공백을 뺀 길이는 *vlen, 없으면 NULL */
+const char *http_field(const char *hdr, size_t len, const char *name, size_t *vlen);
+
+#endif /* __FRESHNESS_H__ */
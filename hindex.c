@@ -0,0 +1,209 @@
+/*
+    hindex.c - open addressing hash index (Swiss table 방식)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "hindex.h"
+#include "csapp.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define CTRL_EMPTY 0x80   // 한 번도 쓰이지 않은 slot. 탐색은 여기서 멈춤
+#define CTRL_DELETED 0xfe // 지워진 slot. 탐색은 계속 진행
+/* 그 밖의 값 (0x00 ~ 0x7f) 은 사용 중인 slot 의 hash 하위 7 bit */
+
+#define H1(hash) ((hash) >> 7)           // 처음 볼 group
+#define H2(hash) ((uint8_t)((hash)&0x7f)) // control byte 에 넣는 tag
+
+/* group 안에서 control byte 가 c 인 slot 들의 bitmask */
+static inline unsigned group_match(const uint8_t *g, uint8_t c)
+{
+#ifdef __SSE2__
+  __m128i ctrl = _mm_load_si128((const __m128i *)g);
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+  unsigned m = 0;
+  for (int i = 0; i < HINDEX_GROUP; i++)
+    m |= (unsigned)(g[i] == c) << i;
+  return m;
+#endif
+}
+
+/* group 안에서 EMPTY 나 DELETED 인 slot 들의 bitmask (최상위 bit 가 켜진 byte) */
+static inline unsigned group_match_free(const uint8_t *g)
+{
+#ifdef __SSE2__
+  return _mm_movemask_epi8(_mm_load_si128((const __m128i *)g));
+#else
+  unsigned m = 0;
+  for (int i = 0; i < HINDEX_GROUP; i++)
+    m |= (unsigned)(g[i] >> 7) << i;
+  return m;
+#endif
+}
+
+uint64_t hindex_hash(const char *s)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  while (*s)
+  {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211ULL;
+  }
+  /* FNV 는 하위 bit 가 고르게 섞이지 않으므로 한 번 더 섞음 (tag 는 하위 7 bit, group 은 그 위 bit 를 씀) */
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* table 하나를 한 번에 할당 (header, control byte, 값 순서). free 한 번으로 회수됨 */
+static hindex_table_t *alloc_table(size_t nslots)
+{
+  hindex_table_t *t;
+  size_t hdr = (sizeof(hindex_table_t) + HINDEX_GROUP - 1) & ~(size_t)(HINDEX_GROUP - 1);
+
+  if (posix_memalign((void **)&t, HINDEX_GROUP, hdr + nslots + nslots * sizeof(int32_t)) != 0)
+    unix_error("hindex_init error");
+  t->mask = nslots - 1;
+  t->ctrl = (uint8_t *)t + hdr;
+  t->slots = (int32_t *)(t->ctrl + nslots);
+  memset(t->ctrl, CTRL_EMPTY, nslots);
+  return t;
+}
+
+void hindex_init(hindex_t *ix, size_t capacity, uint64_t (*hash_of)(int32_t, void *), void *arg)
+{
+  size_t nslots = HINDEX_GROUP;
+
+  // 절반 이하로만 채워서 탐색이 대부분 첫 group 에서 끝나도록 함
+  while (nslots < capacity * 2)
+    nslots <<= 1;
+  ix->hash_of = hash_of;
+  ix->arg = arg;
+  ix->retire = NULL;
+  ix->used = 0;
+  ix->tombs = 0;
+  atomic_init(&ix->tab, alloc_table(nslots));
+}
+
+void hindex_free(hindex_t *ix)
+{
+  free(atomic_load(&ix->tab));
+  atomic_store(&ix->tab, NULL);
+}
+
+/* hash 가 처음 볼 group 의 시작 slot. 다음 group 은 1, 2, 3 ... 칸씩 건너뜀 (group 수가 2의 거듭제곱이면 모든 group 을 한 번씩 봄) */
+static inline size_t probe_start(hindex_table_t *t, uint64_t hash)
+{
+  return (H1(hash) * HINDEX_GROUP) & t->mask;
+}
+
+int32_t hindex_find(hindex_t *ix, uint64_t hash, hindex_eq_t eq, const void *key)
+{
+  hindex_table_t *t = atomic_load_explicit(&ix->tab, memory_order_acquire);
+  size_t pos = probe_start(t, hash);
+  uint8_t tag = H2(hash);
+
+  for (size_t step = HINDEX_GROUP;; step += HINDEX_GROUP)
+  {
+    const uint8_t *g = t->ctrl + pos;
+    unsigned m = group_match(g, tag);
+
+    atomic_thread_fence(memory_order_acquire); // control byte 를 본 뒤에 값을 읽음 (writer 는 값 -> control byte 순서)
+    for (; m; m &= m - 1)
+    {
+      int32_t value = atomic_load_explicit((_Atomic int32_t *)&t->slots[pos + __builtin_ctz(m)], memory_order_relaxed);
+      if (eq(value, key, ix->arg))
+        return value;
+    }
+    if (group_match(g, CTRL_EMPTY)) // 빈 slot 이 있는 group 너머에는 이 key 가 없음
+      return -1;
+    if (step > t->mask) // 모든 group 을 봄
+      return -1;
+    pos = (pos + step) & t->mask;
+  }
+}
+
+static inline void set_ctrl(hindex_table_t *t, size_t i, uint8_t c)
+{
+  atomic_store_explicit((_Atomic uint8_t *)&t->ctrl[i], c, memory_order_release);
+}
+
+/* 재배치 없이 빈 slot 에 넣기 */
+static void insert_slot(hindex_t *ix, hindex_table_t *t, uint64_t hash, int32_t value)
+{
+  size_t pos = probe_start(t, hash);
+  unsigned m;
+
+  for (size_t step = HINDEX_GROUP; !(m = group_match_free(t->ctrl + pos)); step += HINDEX_GROUP)
+    pos = (pos + step) & t->mask;
+  pos += __builtin_ctz(m);
+  if (t->ctrl[pos] == CTRL_DELETED)
+    ix->tombs--;
+  atomic_store_explicit((_Atomic int32_t *)&t->slots[pos], value, memory_order_relaxed);
+  set_ctrl(t, pos, H2(hash)); // 값을 쓴 다음에 reader 에게 보이게 함
+  ix->used++;
+}
+
+/* tombstone 을 치우고, 많이 찼으면 slot 수를 두 배로. 새 table 을 다 채운 뒤 한 번에 바꿈 */
+static void rehash(hindex_t *ix)
+{
+  hindex_table_t *old = atomic_load_explicit(&ix->tab, memory_order_relaxed);
+  size_t old_nslots = old->mask + 1;
+  hindex_table_t *t = alloc_table(ix->used * 2 >= old_nslots ? old_nslots * 2 : old_nslots);
+
+  ix->used = 0;
+  ix->tombs = 0;
+  for (size_t i = 0; i < old_nslots; i++)
+    if (!(old->ctrl[i] & 0x80))
+      insert_slot(ix, t, ix->hash_of(old->slots[i], ix->arg), old->slots[i]);
+  atomic_store_explicit(&ix->tab, t, memory_order_release);
+  if (ix->retire)
+    ix->retire(old);
+  else
+    free(old);
+}
+
+void hindex_insert(hindex_t *ix, uint64_t hash, int32_t value)
+{
+  size_t nslots = atomic_load_explicit(&ix->tab, memory_order_relaxed)->mask + 1;
+
+  if (ix->used + ix->tombs + 1 > nslots - nslots / 8)
+    rehash(ix);
+  insert_slot(ix, atomic_load_explicit(&ix->tab, memory_order_relaxed), hash, value);
+}
+
+int hindex_erase(hindex_t *ix, uint64_t hash, int32_t value)
+{
+  hindex_table_t *t = atomic_load_explicit(&ix->tab, memory_order_relaxed);
+  size_t pos = probe_start(t, hash);
+  uint8_t tag = H2(hash);
+
+  for (size_t step = HINDEX_GROUP;; step += HINDEX_GROUP)
+  {
+    uint8_t *g = t->ctrl + pos;
+    for (unsigned m = group_match(g, tag); m; m &= m - 1)
+    {
+      size_t i = pos + __builtin_ctz(m);
+      if (t->slots[i] != value)
+        continue;
+      /* 이 group 에 원래 빈 slot 이 있었다면 이 group 을 지나쳐 간 탐색이 없으므로 EMPTY 로 돌려도 됨 */
+      if (group_match(g, CTRL_EMPTY))
+        set_ctrl(t, i, CTRL_EMPTY);
+      else
+      {
+        set_ctrl(t, i, CTRL_DELETED);
+        ix->tombs++;
+      }
+      ix->used--;
+      return 0;
+    }
+    if (group_match(g, CTRL_EMPTY) || step > t->mask)
+      return -1;
+    pos = (pos + step) & t->mask;
+  }
+}
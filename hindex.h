@@ -0,0 +1,59 @@
+/*
+    hindex.h - open addressing hash index (Swiss table 방식)
+
+    key 를 직접 들고 있지 않고, 미리 계산한 64 bit hash 와 int32 값(cache block 번호 등)만 저장함.
+    slot 마다 control byte 하나 (EMPTY / DELETED / hash 하위 7 bit tag) 를 따로 모아 두고,
+    16 개씩 묶은 group 을 SSE2 비교 한 번으로 검사해서 tag 가 같은 slot 만 key 비교를 함.
+    그래서 찾는 key 가 없을 때도 보통 control byte 16 개 (cache line 하나) 만 보고 끝남.
+
+    - hash 상위 bit 로 처음 볼 group 을 정하고, 빈 slot 이 있는 group 을 만날 때까지 group 단위로 탐색
+    - 지울 때는 그 group 에 빈 slot 이 남아 있으면 EMPTY, 아니면 DELETED (tombstone) 로 표시
+    - 사용 중 + tombstone 이 7/8 을 넘으면 hash_of 로 다시 계산해서 재배치
+    - writer 는 한 번에 하나만 (호출하는 쪽에서 보호). reader 는 writer 와 동시에 hindex_find 가능:
+      값을 먼저 쓰고 control byte 를 나중에 쓰며, 재배치는 새 table 을 만들어 포인터를 바꾼 뒤
+      옛 table 을 retire 로 넘김 (reader 가 다 빠져나간 뒤 free 하도록, epoch.c).
+      대신 reader 는 지워지는 중인 값을 받을 수 있으므로 eq 에서 key 를 확인해야 함
+*/
+#ifndef __HINDEX_H__
+#define __HINDEX_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define HINDEX_GROUP 16 // control byte 를 한 번에 비교하는 단위 (SSE2 레지스터 하나)
+
+/* slot 배열. 재배치할 때 통째로 바꿈 */
+typedef struct
+{
+  size_t mask;    // slot 수 - 1 (slot 수는 2의 거듭제곱, HINDEX_GROUP 이상)
+  uint8_t *ctrl;  // slot 마다 control byte
+  int32_t *slots; // slot 마다 값
+} hindex_table_t;
+
+typedef struct
+{
+  _Atomic(hindex_table_t *) tab;
+  size_t used;  // 값이 들어 있는 slot 수
+  size_t tombs; // DELETED slot 수
+
+  uint64_t (*hash_of)(int32_t value, void *arg); // 재배치할 때 값의 hash 를 다시 얻는 함수
+  void *arg;
+  void (*retire)(void *old_table); // 재배치로 버려진 table 회수. NULL 이면 바로 free
+} hindex_t;
+
+/* key 비교 함수. value 가 가리키는 항목의 key 가 key 와 같으면 1 */
+typedef int (*hindex_eq_t)(int32_t value, const void *key, void *arg);
+
+/* 문자열 hash (FNV-1a 64 bit) */
+uint64_t hindex_hash(const char *s);
+
+/* capacity 개를 넣어도 재배치가 없도록 slot 수를 잡음 */
+void hindex_init(hindex_t *ix, size_t capacity, uint64_t (*hash_of)(int32_t, void *), void *arg);
+void hindex_free(hindex_t *ix);
+
+int32_t hindex_find(hindex_t *ix, uint64_t hash, hindex_eq_t eq, const void *key); // 없으면 -1
+void hindex_insert(hindex_t *ix, uint64_t hash, int32_t value);                   // 같은 key 가 없을 때만 호출
+int hindex_erase(hindex_t *ix, uint64_t hash, int32_t value);                     // 없으면 -1
+
+#endif /* __HINDEX_H__ */
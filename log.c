@@ -0,0 +1,160 @@
+/*
+    log.c - 비동기 접속 로그와 accept 통계
+*/
+#include <stdarg.h>
+#include "log.h"
+#include "ring.h"
+#include "timer.h"
+
+enum
+{
+  LOG_ACCEPT,
+  LOG_HIT,
+  LOG_INFO, // log_msg. stdout
+  LOG_ERROR // log_msg. stderr
+};
+
+typedef struct
+{
+  int kind;
+  const char *tier; // LOG_HIT 일 때만
+  socklen_t addrlen;
+  union
+  {
+    struct sockaddr_storage addr;
+    char text[LOG_URI_MAX]; // hit 한 uri 나 메시지
+  };
+} log_rec_t;
+
+static ring_t log_ring;
+static int log_verbose = 1;
+static int log_stats_interval = 0;
+static int log_running = 0;
+
+static atomic_long accepted; // 지금까지 accept 한 연결 수
+static atomic_long dropped;  // ring 이 가득 차서 버린 로그 수
+static atomic_long shed;     // 과부하로 503 을 보내고 버린 연결 수
+
+/* 일정 시간마다 accept 속도 출력 */
+static void print_stats(long long *last_ms, long *last_accepted)
+{
+  long long now = tw_now_ms();
+  long total = atomic_load_explicit(&accepted, memory_order_relaxed);
+
+  if (now - *last_ms < log_stats_interval * 1000LL)
+    return;
+  fprintf(stderr, "accept rate: %.0f conn/s (total %ld, shed %ld, log dropped %ld)\n",
+          (total - *last_accepted) * 1000.0 / (now - *last_ms), total,
+          atomic_load_explicit(&shed, memory_order_relaxed),
+          atomic_load_explicit(&dropped, memory_order_relaxed));
+  *last_ms = now;
+  *last_accepted = total;
+}
+
+static void *log_thread(void *arg)
+{
+  log_rec_t rec;
+  char hostname[MAXLINE], port[MAXLINE];
+  long long last_ms = tw_now_ms();
+  long last_accepted = 0;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    if (ring_pop(&log_ring, &rec) == 0)
+    {
+      if (rec.kind == LOG_HIT)
+        printf("\n%s hit ! ====> %s\n", rec.tier, rec.text);
+      else if (rec.kind == LOG_INFO)
+        fputs(rec.text, stdout);
+      else if (rec.kind == LOG_ERROR)
+        fputs(rec.text, stderr);
+      // resolver 가 느려도 이 thread 만 기다림
+      else if (getnameinfo((SA *)&rec.addr, rec.addrlen, hostname, MAXLINE, port, MAXLINE, 0) == 0)
+        printf("Accepted connection from (%s %s).\n", hostname, port);
+      continue;
+    }
+
+    /* 쌓인 로그를 다 출력했으면 내보내고 잠듦. 통계를 찍어야 하면 그 주기마다 깨어남 */
+    fflush(stdout);
+    if (log_stats_interval > 0)
+      print_stats(&last_ms, &last_accepted);
+    unsigned key = ring_prepare_wait(&log_ring);
+    if (ring_count(&log_ring) > 0)
+    {
+      ring_cancel_wait(&log_ring);
+      continue;
+    }
+    ring_timedwait(&log_ring, key, log_stats_interval > 0 ? log_stats_interval * 1000L : -1);
+  }
+  return NULL;
+}
+
+void log_start(int verbose, int stats_interval)
+{
+  pthread_t tid;
+
+  log_verbose = verbose;
+  log_stats_interval = stats_interval;
+  atomic_init(&accepted, 0);
+  atomic_init(&dropped, 0);
+  atomic_init(&shed, 0);
+
+  // 오류 메시지는 verbose 가 0 이어도 남기므로 thread 는 항상 만듦
+  ring_init(&log_ring, LOG_RING_SIZE, sizeof(log_rec_t));
+  log_running = 1;
+  Pthread_create(&tid, NULL, log_thread, NULL);
+}
+
+void log_accept(struct sockaddr *addr, socklen_t addrlen)
+{
+  log_rec_t rec;
+
+  atomic_fetch_add_explicit(&accepted, 1, memory_order_relaxed);
+  if (!log_verbose || !log_running)
+    return;
+
+  rec.kind = LOG_ACCEPT;
+  rec.addrlen = addrlen;
+  memcpy(&rec.addr, addr, addrlen);
+  if (ring_push(&log_ring, &rec) < 0)
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+}
+
+void log_hit(const char *tier, const char *uri)
+{
+  log_rec_t rec;
+
+  if (!log_verbose || !log_running)
+    return;
+
+  rec.kind = LOG_HIT;
+  rec.tier = tier;
+  snprintf(rec.text, sizeof(rec.text), "%s", uri);
+  if (ring_push(&log_ring, &rec) < 0)
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+}
+
+void log_msg(int error, const char *fmt, ...)
+{
+  log_rec_t rec;
+  va_list ap;
+  int n;
+
+  if ((!error && !log_verbose) || !log_running)
+    return;
+
+  rec.kind = error ? LOG_ERROR : LOG_INFO;
+  va_start(ap, fmt);
+  n = vsnprintf(rec.text, sizeof(rec.text), fmt, ap);
+  va_end(ap);
+  if (n >= (int)sizeof(rec.text)) // 잘렸으면 줄바꿈은 남김
+    rec.text[sizeof(rec.text) - 2] = '\n';
+  if (ring_push(&log_ring, &rec) < 0)
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+}
+
+void log_shed(void)
+{
+  atomic_fetch_add_explicit(&shed, 1, memory_order_relaxed);
+}
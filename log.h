@@ -0,0 +1,37 @@
+/*
+    log.h - 비동기 접속 로그와 accept 통계
+
+    accept 하는 thread 는 클라이언트 주소를 lock-free ring (ring.c) 에 값 그대로 넣기만 하고,
+    getnameinfo (역방향 DNS 조회 가능) 와 printf 는 로그 thread 하나가 따로 처리함.
+    그래서 resolver 가 느리거나 stdout 이 막혀도 accept 속도는 영향을 받지 않음.
+    캐시 hit 로그도 같은 ring 으로 넘겨서 hit 경로가 stdout lock 을 잡지 않게 함 (uri 는 LOG_URI_MAX 까지만).
+    event loop (proxy_event.c) 의 요청 줄, 연결 실패 같은 메시지도 log_msg 로 넘김. loop thread 하나가 stdout 에 막히면
+    그 loop 의 연결이 모두 멈추므로 loop thread 는 stdio 를 직접 쓰지 않음.
+    ring 이 가득 차면 로그를 버리고 버린 개수만 셈.
+*/
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include "csapp.h"
+
+#define LOG_RING_SIZE 4096
+#define LOG_URI_MAX 256 // hit 로그에 남기는 uri, log_msg 메시지 길이
+
+/* 로그 thread 시작. verbose 가 0 이면 접속 / hit / 일반 메시지를 남기지 않음 (오류 메시지는 남김),
+   stats_interval 초마다 accept 속도 출력 (0 이면 끔) */
+void log_start(int verbose, int stats_interval);
+
+/* accept 직후 호출. 주소 복사와 카운터 증가만 함 (시스템 콜 없음, 로그 thread 가 잠들어 있을 때만 futex wake) */
+void log_accept(struct sockaddr *addr, socklen_t addrlen);
+
+/* 캐시 hit. tier 는 "cache" (메모리) 나 "disk". uri 를 복사만 하고 출력은 로그 thread 가 함 */
+void log_hit(const char *tier, const char *uri);
+
+/* 한 줄 메시지 (printf 형식, 줄바꿈은 호출하는 쪽이 붙임). error 가 0 이 아니면 stderr 로, verbose 가 0 이어도 남김.
+   형식만 맞춰 ring 에 넣고 출력은 로그 thread 가 함 */
+void log_msg(int error, const char *fmt, ...);
+
+/* 과부하로 버린 연결 수 (통계용) */
+void log_shed(void);
+
+#endif /* __LOG_H__ */
@@ -0,0 +1,131 @@
+/*
+    policy.c - 소거 정책 목록, 정책 구현들이 같이 쓰는 목록 / ghost
+*/
+#include <string.h>
+#include "policy.h"
+#include "csapp.h"
+
+static const cache_policy_t *policies[] = {&policy_wtinylfu, &policy_arc, &policy_s3fifo, &policy_gdsf};
+
+const cache_policy_t *policy_find(const char *name)
+{
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++)
+    if (!strcmp(policies[i]->name, name))
+      return policies[i];
+  return NULL;
+}
+
+policy_node_t *policy_node(policy_nodes_t *ns, int index)
+{
+  if (index >= ns->cap)
+  {
+    int cap = ns->cap ? ns->cap : 1024;
+
+    while (cap <= index)
+      cap *= 2;
+    ns->nodes = Realloc(ns->nodes, cap * sizeof(policy_node_t));
+    memset(&ns->nodes[ns->cap], 0, (cap - ns->cap) * sizeof(policy_node_t));
+    ns->cap = cap;
+  }
+  return &ns->nodes[index];
+}
+
+void policy_nodes_free(policy_nodes_t *ns)
+{
+  free(ns->nodes);
+  ns->nodes = NULL;
+  ns->cap = 0;
+}
+
+void policy_list_unlink(policy_nodes_t *ns, policy_list_t *l, int index)
+{
+  policy_node_t *n = &ns->nodes[index];
+
+  if (n->prev >= 0)
+    ns->nodes[n->prev].next = n->next;
+  else
+    l->head = n->next;
+  if (n->next >= 0)
+    ns->nodes[n->next].prev = n->prev;
+  else
+    l->tail = n->prev;
+  l->bytes -= n->bytes;
+  n->queue = 0;
+}
+
+void policy_list_push(policy_nodes_t *ns, policy_list_t *l, int index)
+{
+  policy_node_t *n = &ns->nodes[index];
+
+  n->prev = -1;
+  n->next = l->head;
+  if (l->head >= 0)
+    ns->nodes[l->head].prev = index;
+  else
+    l->tail = index;
+  l->head = index;
+  l->bytes += n->bytes;
+}
+
+/* ghost 는 hash 만 기억하므로 hash 가 같으면 같은 응답으로 봄 */
+static uint64_t ghost_hash(int32_t slot, void *arg)
+{
+  return ((policy_ghost_t *)arg)->nodes.nodes[slot].hash;
+}
+
+static int ghost_eq(int32_t slot, const void *key, void *arg)
+{
+  return ((policy_ghost_t *)arg)->nodes.nodes[slot].hash == *(const uint64_t *)key;
+}
+
+void policy_ghost_init(policy_ghost_t *g)
+{
+  memset(g, 0, sizeof(*g));
+  g->list = POLICY_LIST_INIT;
+  g->free_head = -1;
+  hindex_init(&g->index, 1024, ghost_hash, g); // ghost 는 lock 안에서만 찾으므로 옛 table 은 바로 free (retire 없음)
+}
+
+void policy_ghost_free(policy_ghost_t *g)
+{
+  policy_nodes_free(&g->nodes);
+  hindex_free(&g->index);
+}
+
+int policy_ghost_find(policy_ghost_t *g, uint64_t hash)
+{
+  return hindex_find(&g->index, hash, ghost_eq, &hash);
+}
+
+void policy_ghost_add(policy_ghost_t *g, uint64_t hash, size_t bytes)
+{
+  int slot;
+  policy_node_t *n;
+
+  if ((slot = policy_ghost_find(g, hash)) >= 0)
+    policy_ghost_erase(g, slot);
+  if ((slot = g->free_head) >= 0)
+    g->free_head = g->nodes.nodes[slot].next;
+  else
+    slot = g->nused++;
+  n = policy_node(&g->nodes, slot);
+  n->hash = hash;
+  n->bytes = bytes;
+  n->queue = 1;
+  policy_list_push(&g->nodes, &g->list, slot);
+  hindex_insert(&g->index, hash, slot);
+}
+
+void policy_ghost_erase(policy_ghost_t *g, int slot)
+{
+  policy_list_unlink(&g->nodes, &g->list, slot);
+  hindex_erase(&g->index, g->nodes.nodes[slot].hash, slot);
+  g->nodes.nodes[slot].next = g->free_head;
+  g->free_head = slot;
+}
+
+void policy_ghost_trim(policy_ghost_t *g, size_t max_bytes)
+{
+  while (g->list.bytes > max_bytes && g->list.tail >= 0)
+    policy_ghost_erase(g, g->list.tail);
+}
@@ -0,0 +1,122 @@
+/*
+    policy.h - 캐시 소거 정책 인터페이스
+
+    캐시 (cache.c) 는 cache block 번호와 byte 수만 넘기고, 어떤 block 을 먼저 소거할지는 정책이 정함.
+    정책은 shard 마다 상태를 하나씩 만들고 (create), 모든 함수는 shard->lock 을 잡은 상태에서 불림.
+    - access : miss. 아직 캐시에 없는 uri 가 요청됨 (빈도를 세는 정책만 씀)
+    - insert : 새 응답이 block index 에 들어옴
+    - update : 같은 uri 의 새 응답으로 바꿔 끼움 (크기가 바뀔 수 있음)
+    - hit    : 캐시 hit. hit 경로는 lock 을 잡지 않으므로 thread 마다 모아 두었다가 늦게, 일부는 빠진 채로 불림
+    - victim : byte 한도를 넘었을 때 다음에 소거할 block. 정책 안의 순서를 바꿀 수는 있지만 목록에서 빼지는 않음.
+               비었으면 -1. 방금 넣은 block 을 돌려주면 입장 거절이 됨
+    - remove : block 이 캐시에서 빠짐. victim 으로 소거된 경우뿐 아니라 만료 (entry_timer) 로 빠질 때도 불림.
+               소거인지는 마지막 victim 이 돌려준 block 인지로 가림 (ghost 나 GDSF 의 L 은 소거일 때만). 같은 uri 의 교체는 update 로 옴.
+               이 뒤로 같은 block 번호가 새 응답에 다시 쓰일 수 있음
+
+    고르는 방법은 두 가지
+    - 실행할 때 : cache_set_policy("arc") (proxy_cache -p). shard 마다 함수 표 (cache_policy_t) 를 거쳐 부름
+    - 빌드할 때 : make CACHE_POLICY=arc. cache.c 가 그 정책의 함수 (arc_hit 등) 를 직접 부르고 다른 정책은 고를 수 없음
+
+    구현
+    - wtinylfu : W-TinyLFU (기본값). window LRU + SLRU main, TinyLFU 빈도로 입장 판정 (policy_wtinylfu.c)
+    - arc      : Adaptive Replacement Cache. 최근 (T1) / 자주 (T2) 목록의 비율을 ghost hit 으로 조절 (policy_arc.c)
+    - s3fifo   : S3-FIFO. 작은 FIFO 에서 한 번도 hit 하지 않은 응답은 바로 내보내고 main FIFO 는 재삽입 (policy_s3fifo.c)
+    - gdsf     : GreedyDual-Size-Frequency. 빈도 / 크기가 작은 응답부터 소거 (policy_gdsf.c)
+*/
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hindex.h"
+
+typedef struct
+{
+  const char *name;
+  void *(*create)(size_t max_bytes);
+  void (*destroy)(void *p);
+  void (*access)(void *p, uint64_t hash);
+  void (*insert)(void *p, int index, uint64_t hash, size_t bytes);
+  void (*update)(void *p, int index, size_t bytes);
+  void (*hit)(void *p, int index);
+  int (*victim)(void *p);
+  void (*remove)(void *p, int index);
+} cache_policy_t;
+
+/* 정책마다 함수 이름이 <이름>_insert 처럼 정해져 있어서 빌드할 때 고른 정책은 이름으로 바로 부를 수 있음 */
+#define POLICY_DECLARE(name)                                              \
+  void *name##_create(size_t max_bytes);                                  \
+  void name##_destroy(void *p);                                           \
+  void name##_access(void *p, uint64_t hash);                             \
+  void name##_insert(void *p, int index, uint64_t hash, size_t bytes);    \
+  void name##_update(void *p, int index, size_t bytes);                   \
+  void name##_hit(void *p, int index);                                    \
+  int name##_victim(void *p);                                             \
+  void name##_remove(void *p, int index);                                 \
+  extern const cache_policy_t policy_##name
+
+#define POLICY_DEFINE(name)                                                              \
+  const cache_policy_t policy_##name = {#name, name##_create, name##_destroy, name##_access, \
+                                        name##_insert, name##_update, name##_hit,          \
+                                        name##_victim, name##_remove}
+
+POLICY_DECLARE(wtinylfu);
+POLICY_DECLARE(arc);
+POLICY_DECLARE(s3fifo);
+POLICY_DECLARE(gdsf);
+
+/* 이름으로 정책 찾기. 없으면 NULL */
+const cache_policy_t *policy_find(const char *name);
+
+/* ---- 정책 구현들이 같이 쓰는 것 ---- */
+
+/* block 하나에 대한 정책 정보. 정책마다 block 번호로 찾는 배열을 따로 가짐 (cache block 은 조회하는 thread 가
+   읽으므로 정책이 쓰는 값은 거기 두지 않음) */
+typedef struct
+{
+  int prev, next; // 같은 목록의 앞 (더 최근) / 뒤 번호. 없으면 -1
+  size_t bytes;
+  uint64_t hash;
+  char queue;     // 들어 있는 목록 (정책마다 다름. 0 은 어디에도 없음)
+  uint8_t freq;
+} policy_node_t;
+
+typedef struct
+{
+  policy_node_t *nodes;
+  int cap;
+} policy_nodes_t;
+
+/* 이중 연결 리스트. head 가 가장 최근 */
+typedef struct
+{
+  int head, tail;
+  size_t bytes; // 든 항목들의 byte 수
+} policy_list_t;
+
+#define POLICY_LIST_INIT ((policy_list_t){-1, -1, 0})
+
+/* index 번 node. 배열이 작으면 늘림 */
+policy_node_t *policy_node(policy_nodes_t *ns, int index);
+void policy_nodes_free(policy_nodes_t *ns);
+void policy_list_unlink(policy_nodes_t *ns, policy_list_t *l, int index);
+void policy_list_push(policy_nodes_t *ns, policy_list_t *l, int index); // head 에 넣음
+
+/* ghost 목록: 최근 소거된 응답의 hash 와 크기만 기억 (ARC 의 B1 / B2, S3-FIFO 의 G) */
+typedef struct
+{
+  policy_nodes_t nodes;
+  policy_list_t list;
+  int free_head;   // 비어 있는 node 번호. next 로 이어짐
+  int nused;       // 한 번이라도 쓰인 node 수
+  hindex_t index;  // hash -> node 번호
+} policy_ghost_t;
+
+void policy_ghost_init(policy_ghost_t *g);
+void policy_ghost_free(policy_ghost_t *g);
+int policy_ghost_find(policy_ghost_t *g, uint64_t hash); // 없으면 -1
+void policy_ghost_add(policy_ghost_t *g, uint64_t hash, size_t bytes);
+void policy_ghost_erase(policy_ghost_t *g, int slot);
+void policy_ghost_trim(policy_ghost_t *g, size_t max_bytes); // 가장 오래된 것부터 지워서 max_bytes 이하로
+
+#endif /* __POLICY_H__ */
@@ -0,0 +1,160 @@
+/*
+    policy_arc.c - ARC (Adaptive Replacement Cache) 소거 정책
+
+    캐시에 든 응답을 두 LRU 목록으로 나눔
+    - T1 : 들어온 뒤 한 번도 hit 하지 않은 응답 (최근성)
+    - T2 : 두 번 이상 요청된 응답 (빈도). T1 / T2 에서 hit 하면 T2 의 맨 앞으로
+    T1 에서 소거된 응답은 B1, T2 에서 소거된 응답은 B2 ghost 목록에 hash 와 크기만 남김.
+    다시 요청되어 들어올 때 B1 에 있었으면 "T1 이 더 컸어야 했다" 고 보고 T1 목표 크기 p 를 늘리고,
+    B2 에 있었으면 줄임. 소거는 T1 이 p 보다 크면 T1 에서, 아니면 T2 에서.
+    ghost 는 arc_victim 이 고른 응답이 빠질 때만 남김. 만료로 빠진 응답은 캐시가 작아서 밀려난 것이 아니므로 남기지 않음.
+    원래 ARC 는 페이지 수로 세지만 응답마다 크기가 달라서 여기서는 목록 크기, p, 조절량을 모두 byte 로 셈
+*/
+#include "policy.h"
+#include "csapp.h"
+
+enum
+{
+  Q_NONE,
+  Q_T1,
+  Q_T2
+};
+
+typedef struct
+{
+  policy_nodes_t nodes;
+  policy_list_t t1, t2;
+  policy_ghost_t b1, b2;
+  size_t c; // byte 한도
+  size_t p; // T1 의 목표 byte 수
+  int from_b2; // 마지막으로 들어온 응답이 B2 에 있었는지 (T1 == p 일 때 어느 쪽을 소거할지)
+  int victim;  // arc_victim 이 마지막으로 고른 block (-1 이면 없음)
+} arc_t;
+
+static inline policy_list_t *list_of(arc_t *a, int queue)
+{
+  return queue == Q_T1 ? &a->t1 : &a->t2;
+}
+
+/* |T1| + |B1| <= c, |T1| + |T2| + |B1| + |B2| <= 2c 를 지킴 */
+static void trim_ghosts(arc_t *a)
+{
+  policy_ghost_trim(&a->b1, a->t1.bytes < a->c ? a->c - a->t1.bytes : 0);
+  while (a->t1.bytes + a->t2.bytes + a->b1.list.bytes + a->b2.list.bytes > 2 * a->c)
+  {
+    if (a->b2.list.tail >= 0)
+      policy_ghost_erase(&a->b2, a->b2.list.tail);
+    else if (a->b1.list.tail >= 0)
+      policy_ghost_erase(&a->b1, a->b1.list.tail);
+    else
+      break;
+  }
+}
+
+void *arc_create(size_t max_bytes)
+{
+  arc_t *a = Calloc(1, sizeof(arc_t));
+
+  a->t1 = a->t2 = POLICY_LIST_INIT;
+  policy_ghost_init(&a->b1);
+  policy_ghost_init(&a->b2);
+  a->c = max_bytes;
+  a->victim = -1;
+  return a;
+}
+
+void arc_destroy(void *p)
+{
+  arc_t *a = p;
+
+  policy_nodes_free(&a->nodes);
+  policy_ghost_free(&a->b1);
+  policy_ghost_free(&a->b2);
+  free(a);
+}
+
+void arc_access(void *p, uint64_t hash)
+{
+}
+
+void arc_insert(void *p, int index, uint64_t hash, size_t bytes)
+{
+  arc_t *a = p;
+  policy_node_t *n = policy_node(&a->nodes, index);
+  int slot;
+
+  n->hash = hash;
+  n->bytes = bytes;
+  a->from_b2 = 0;
+  if ((slot = policy_ghost_find(&a->b1, hash)) >= 0)
+  {
+    size_t b1 = a->b1.list.bytes, b2 = a->b2.list.bytes;
+    size_t delta = b1 >= b2 ? bytes : bytes * (b2 / b1);
+
+    a->p = a->p + delta < a->c ? a->p + delta : a->c;
+    policy_ghost_erase(&a->b1, slot);
+    n->queue = Q_T2;
+  }
+  else if ((slot = policy_ghost_find(&a->b2, hash)) >= 0)
+  {
+    size_t b1 = a->b1.list.bytes, b2 = a->b2.list.bytes;
+    size_t delta = b2 >= b1 ? bytes : bytes * (b1 / b2);
+
+    a->p = a->p > delta ? a->p - delta : 0;
+    policy_ghost_erase(&a->b2, slot);
+    n->queue = Q_T2;
+    a->from_b2 = 1;
+  }
+  else
+    n->queue = Q_T1;
+  policy_list_push(&a->nodes, list_of(a, n->queue), index);
+  trim_ghosts(a);
+}
+
+void arc_update(void *p, int index, size_t bytes)
+{
+  arc_t *a = p;
+  policy_node_t *n = &a->nodes.nodes[index];
+  policy_list_t *l = list_of(a, n->queue);
+
+  policy_list_unlink(&a->nodes, l, index);
+  n->queue = l == &a->t1 ? Q_T1 : Q_T2;
+  n->bytes = bytes;
+  policy_list_push(&a->nodes, l, index);
+}
+
+void arc_hit(void *p, int index)
+{
+  arc_t *a = p;
+  policy_node_t *n = &a->nodes.nodes[index];
+
+  policy_list_unlink(&a->nodes, list_of(a, n->queue), index);
+  n->queue = Q_T2;
+  policy_list_push(&a->nodes, &a->t2, index);
+}
+
+int arc_victim(void *p)
+{
+  arc_t *a = p;
+
+  if (a->t1.tail >= 0 && (a->t1.bytes > a->p || (a->from_b2 && a->t1.bytes == a->p) || a->t2.tail < 0))
+    return a->victim = a->t1.tail;
+  return a->victim = a->t2.tail;
+}
+
+void arc_remove(void *p, int index)
+{
+  arc_t *a = p;
+  policy_node_t *n = &a->nodes.nodes[index];
+  int queue = n->queue;
+
+  policy_list_unlink(&a->nodes, list_of(a, queue), index);
+  if (index == a->victim) // 소거된 응답만 ghost 로. 만료나 교체로 빠진 응답이 다시 들어와도 p 를 움직이지 않음
+  {
+    policy_ghost_add(queue == Q_T1 ? &a->b1 : &a->b2, n->hash, n->bytes);
+    a->victim = -1;
+  }
+  trim_ghosts(a);
+}
+
+POLICY_DEFINE(arc);
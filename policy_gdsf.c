@@ -0,0 +1,178 @@
+/*
+    policy_gdsf.c - GDSF (GreedyDual-Size-Frequency) 소거 정책
+
+    응답마다 우선순위 H = L + freq * cost / bytes 를 두고 가장 작은 것부터 소거 (min-heap).
+    - freq : 캐시에 들어온 뒤 요청 횟수. 자주 쓰이는 응답일수록 오래 남음
+    - bytes: 같은 빈도면 작은 응답을 남김. 한 자리에 큰 응답 하나 대신 작은 응답 여럿을 두어 hit 수를 늘림
+    - L    : 마지막으로 소거된 응답의 H. 새로 들어오거나 hit 한 응답은 L 위에서 시작하므로,
+             예전에 빈도를 많이 쌓아 두고 더는 요청되지 않는 응답도 결국 소거됨 (aging).
+             victim 으로 고른 (H 가 가장 작은) 응답이 빠질 때만 올림. 만료나 교체로 빠지는 응답은 H 가 커도 L 을 건드리지 않음
+    cost 는 GDSF_COST. 1 이면 hit 수 (object hit ratio) 를, bytes 에 비례하게 두면 byte hit ratio 를 더 봄
+*/
+#include <string.h>
+#include "policy.h"
+#include "csapp.h"
+
+#define GDSF_COST(bytes) 1.0
+
+typedef struct
+{
+  double prio; // H
+  size_t bytes;
+  uint32_t freq;
+  int pos;     // heap 안의 위치
+} gdsf_node_t;
+
+typedef struct
+{
+  gdsf_node_t *nodes; // block 번호로 찾음
+  int *heap;          // block 번호. heap[0] 이 H 가 가장 작음
+  int cap, len;
+  double l;           // L
+  int victim;         // gdsf_victim 이 마지막으로 고른 block (-1 이면 없음)
+} gdsf_t;
+
+static inline double priority(gdsf_t *g, gdsf_node_t *n)
+{
+  return g->l + n->freq * GDSF_COST(n->bytes) / n->bytes;
+}
+
+static void heap_set(gdsf_t *g, int pos, int index)
+{
+  g->heap[pos] = index;
+  g->nodes[index].pos = pos;
+}
+
+static void sift_up(gdsf_t *g, int pos)
+{
+  int index = g->heap[pos];
+  double prio = g->nodes[index].prio;
+
+  while (pos > 0 && g->nodes[g->heap[(pos - 1) / 2]].prio > prio)
+  {
+    heap_set(g, pos, g->heap[(pos - 1) / 2]);
+    pos = (pos - 1) / 2;
+  }
+  heap_set(g, pos, index);
+}
+
+static void sift_down(gdsf_t *g, int pos)
+{
+  int index = g->heap[pos];
+  double prio = g->nodes[index].prio;
+
+  for (;;)
+  {
+    int child = pos * 2 + 1;
+
+    if (child >= g->len)
+      break;
+    if (child + 1 < g->len && g->nodes[g->heap[child + 1]].prio < g->nodes[g->heap[child]].prio)
+      child++;
+    if (g->nodes[g->heap[child]].prio >= prio)
+      break;
+    heap_set(g, pos, g->heap[child]);
+    pos = child;
+  }
+  heap_set(g, pos, index);
+}
+
+/* index 의 H 를 다시 계산해서 heap 위치를 맞춤 */
+static void reprioritize(gdsf_t *g, int index)
+{
+  gdsf_node_t *n = &g->nodes[index];
+
+  n->prio = priority(g, n);
+  sift_up(g, n->pos);
+  sift_down(g, g->nodes[index].pos);
+}
+
+void *gdsf_create(size_t max_bytes)
+{
+  gdsf_t *g = Calloc(1, sizeof(gdsf_t));
+
+  g->victim = -1;
+  return g;
+}
+
+void gdsf_destroy(void *p)
+{
+  gdsf_t *g = p;
+
+  free(g->nodes);
+  free(g->heap);
+  free(g);
+}
+
+void gdsf_access(void *p, uint64_t hash)
+{
+}
+
+void gdsf_insert(void *p, int index, uint64_t hash, size_t bytes)
+{
+  gdsf_t *g = p;
+  gdsf_node_t *n;
+
+  if (index >= g->cap)
+  {
+    int cap = g->cap ? g->cap : 1024;
+
+    while (cap <= index)
+      cap *= 2;
+    g->nodes = Realloc(g->nodes, cap * sizeof(gdsf_node_t));
+    g->heap = Realloc(g->heap, cap * sizeof(int));
+    memset(&g->nodes[g->cap], 0, (cap - g->cap) * sizeof(gdsf_node_t));
+    g->cap = cap;
+  }
+  n = &g->nodes[index];
+  n->bytes = bytes;
+  n->freq = 1;
+  n->prio = priority(g, n);
+  n->pos = g->len++;
+  g->heap[n->pos] = index;
+  sift_up(g, n->pos);
+}
+
+void gdsf_update(void *p, int index, size_t bytes)
+{
+  gdsf_t *g = p;
+
+  g->nodes[index].bytes = bytes;
+  reprioritize(g, index);
+}
+
+void gdsf_hit(void *p, int index)
+{
+  gdsf_t *g = p;
+
+  g->nodes[index].freq++;
+  reprioritize(g, index);
+}
+
+int gdsf_victim(void *p)
+{
+  gdsf_t *g = p;
+
+  return g->victim = g->len > 0 ? g->heap[0] : -1;
+}
+
+void gdsf_remove(void *p, int index)
+{
+  gdsf_t *g = p;
+  int pos = g->nodes[index].pos, last;
+
+  if (index == g->victim) // 소거된 응답의 H 까지 L 을 올림
+  {
+    if (g->nodes[index].prio > g->l)
+      g->l = g->nodes[index].prio;
+    g->victim = -1;
+  }
+  if (--g->len == pos)
+    return;
+  last = g->heap[g->len];
+  heap_set(g, pos, last);
+  sift_up(g, pos);
+  sift_down(g, g->nodes[last].pos);
+}
+
+POLICY_DEFINE(gdsf);
@@ -0,0 +1,154 @@
+/*
+    policy_s3fifo.c - S3-FIFO 소거 정책
+
+    FIFO 세 개로 한 번만 요청되는 응답을 빨리 걸러냄
+    - S : 새 응답이 들어가는 작은 FIFO (byte 한도의 S3FIFO_SMALL_PCT %)
+    - M : main FIFO
+    - G : S 에서 hit 없이 나간 응답의 ghost (hash 와 크기만, M 크기만큼)
+    hit 은 순서를 바꾸지 않고 응답의 freq (최대 S3FIFO_MAX_FREQ) 만 올림.
+    S 에서 나갈 차례가 된 응답은 그 사이 hit 이 있었으면 M 으로 옮기고, 없었으면 소거하면서 G 에 남김 (만료로 빠진 응답은 남기지 않음).
+    G 에 있던 응답이 다시 들어오면 S 를 거치지 않고 바로 M 으로.
+    M 에서 나갈 차례가 된 응답은 freq 가 남아 있으면 하나 줄여서 M 의 맨 앞에 다시 넣음
+*/
+#include "policy.h"
+#include "csapp.h"
+
+#define S3FIFO_SMALL_PCT 10 // S 가 byte 한도에서 차지하는 비율 (%)
+#define S3FIFO_MAX_FREQ 3
+
+enum
+{
+  Q_NONE,
+  Q_SMALL,
+  Q_MAIN
+};
+
+typedef struct
+{
+  policy_nodes_t nodes;
+  policy_list_t small, main;
+  policy_ghost_t ghost;
+  size_t small_max, main_max;
+  int victim; // s3fifo_victim 이 마지막으로 고른 block (-1 이면 없음)
+} s3fifo_t;
+
+static void push(s3fifo_t *s, int queue, int index)
+{
+  policy_list_push(&s->nodes, queue == Q_SMALL ? &s->small : &s->main, index);
+  s->nodes.nodes[index].queue = queue;
+}
+
+static void unlink_node(s3fifo_t *s, int index)
+{
+  policy_list_unlink(&s->nodes, s->nodes.nodes[index].queue == Q_SMALL ? &s->small : &s->main, index);
+}
+
+void *s3fifo_create(size_t max_bytes)
+{
+  s3fifo_t *s = Calloc(1, sizeof(s3fifo_t));
+
+  s->small = s->main = POLICY_LIST_INIT;
+  policy_ghost_init(&s->ghost);
+  s->small_max = max_bytes * S3FIFO_SMALL_PCT / 100;
+  s->main_max = max_bytes - s->small_max;
+  s->victim = -1;
+  return s;
+}
+
+void s3fifo_destroy(void *p)
+{
+  s3fifo_t *s = p;
+
+  policy_nodes_free(&s->nodes);
+  policy_ghost_free(&s->ghost);
+  free(s);
+}
+
+void s3fifo_access(void *p, uint64_t hash)
+{
+}
+
+void s3fifo_insert(void *p, int index, uint64_t hash, size_t bytes)
+{
+  s3fifo_t *s = p;
+  policy_node_t *n = policy_node(&s->nodes, index);
+  int slot;
+
+  n->hash = hash;
+  n->bytes = bytes;
+  n->freq = 0;
+  if ((slot = policy_ghost_find(&s->ghost, hash)) >= 0)
+  {
+    policy_ghost_erase(&s->ghost, slot);
+    push(s, Q_MAIN, index);
+  }
+  else
+    push(s, Q_SMALL, index);
+}
+
+void s3fifo_update(void *p, int index, size_t bytes)
+{
+  s3fifo_t *s = p;
+  policy_node_t *n = &s->nodes.nodes[index];
+  int queue = n->queue;
+
+  unlink_node(s, index);
+  n->bytes = bytes;
+  push(s, queue, index);
+}
+
+void s3fifo_hit(void *p, int index)
+{
+  policy_node_t *n = &((s3fifo_t *)p)->nodes.nodes[index];
+
+  if (n->freq < S3FIFO_MAX_FREQ)
+    n->freq++;
+}
+
+int s3fifo_victim(void *p)
+{
+  s3fifo_t *s = p;
+  int index;
+
+  for (;;)
+  {
+    if (s->small.tail >= 0 && (s->small.bytes > s->small_max || s->main.tail < 0))
+    {
+      index = s->small.tail;
+      if (s->nodes.nodes[index].freq == 0)
+        return s->victim = index;
+      unlink_node(s, index); // S 에 있는 동안 hit 함
+      s->nodes.nodes[index].freq = 0;
+      push(s, Q_MAIN, index);
+    }
+    else if ((index = s->main.tail) >= 0)
+    {
+      if (s->nodes.nodes[index].freq == 0)
+        return s->victim = index;
+      unlink_node(s, index);
+      s->nodes.nodes[index].freq--;
+      push(s, Q_MAIN, index);
+    }
+    else
+      return -1;
+  }
+}
+
+void s3fifo_remove(void *p, int index)
+{
+  s3fifo_t *s = p;
+  policy_node_t *n = &s->nodes.nodes[index];
+
+  if (index == s->victim) // 만료나 교체로 빠진 응답은 G 에 남기지 않음
+  {
+    if (n->queue == Q_SMALL)
+    {
+      policy_ghost_add(&s->ghost, n->hash, n->bytes);
+      policy_ghost_trim(&s->ghost, s->main_max);
+    }
+    s->victim = -1;
+  }
+  unlink_node(s, index);
+}
+
+POLICY_DEFINE(s3fifo);
@@ -0,0 +1,160 @@
+/*
+    policy_wtinylfu.c - W-TinyLFU 소거 정책
+
+    한 번 요청되고 마는 응답 (crawler 등) 이 자주 쓰이는 응답을 밀어내지 않도록
+    - 새 응답은 먼저 작은 window LRU (byte 한도의 WTINYLFU_WINDOW_PCT %) 에 들어감
+    - window 에서 밀려난 응답은 main (SLRU: probation + protected) 에 들어가려는 후보가 되고,
+      main 에 자리가 없으면 main 의 victim (probation 의 가장 오래된 응답) 보다 최근 요청 빈도가 높을 때만 들어감.
+      아니면 후보 쪽을 버림
+    - probation 에서 다시 hit 한 응답은 protected 로 올라가고, protected 가 넘치면 가장 오래된 것이 probation 으로 내려감
+    - 요청 빈도는 TinyLFU sketch (tinylfu.c) 로 추정. miss (access) 와 hit 을 모두 셈
+*/
+#include "policy.h"
+#include "tinylfu.h"
+#include "csapp.h"
+
+#define WTINYLFU_WINDOW_PCT 1       // window LRU 가 byte 한도에서 차지하는 비율 (%)
+#define WTINYLFU_PROTECTED_PCT 80   // protected 가 main 에서 차지할 수 있는 비율 (%)
+#define WTINYLFU_SKETCH_OBJECT 1024 // sketch 크기를 정할 때 어림잡는 응답 하나의 크기
+
+enum
+{
+  Q_NONE,
+  Q_WINDOW,    // 새로 들어온 응답
+  Q_PROBATION, // main 에 들어왔지만 아직 다시 hit 하지 않은 응답
+  Q_PROTECTED  // main 에서 다시 hit 한 응답
+};
+
+typedef struct
+{
+  policy_nodes_t nodes;
+  policy_list_t lists[4]; // queue 번호로 찾음 (Q_NONE 자리는 쓰지 않음)
+  size_t window_max, main_max, protected_max;
+  tinylfu_t sketch;
+} wtinylfu_t;
+
+static void move_to(wtinylfu_t *w, int queue, int index)
+{
+  policy_node_t *n = &w->nodes.nodes[index];
+
+  if (n->queue != Q_NONE)
+    policy_list_unlink(&w->nodes, &w->lists[(int)n->queue], index);
+  policy_list_push(&w->nodes, &w->lists[queue], index);
+  n->queue = queue;
+}
+
+static inline size_t main_bytes(wtinylfu_t *w)
+{
+  return w->lists[Q_PROBATION].bytes + w->lists[Q_PROTECTED].bytes;
+}
+
+/* main 에서 다음에 소거할 것. probation 의 가장 오래된 것, 비었으면 protected 의 가장 오래된 것 */
+static int main_victim(wtinylfu_t *w)
+{
+  return w->lists[Q_PROBATION].tail >= 0 ? w->lists[Q_PROBATION].tail : w->lists[Q_PROTECTED].tail;
+}
+
+/* window 가 넘치면 main 에 자리가 있는 만큼 가장 오래된 것부터 probation 으로 옮김 */
+static void spill_window(wtinylfu_t *w)
+{
+  int cand;
+
+  while (w->lists[Q_WINDOW].bytes > w->window_max && (cand = w->lists[Q_WINDOW].tail) >= 0 &&
+         main_bytes(w) + w->nodes.nodes[cand].bytes <= w->main_max)
+    move_to(w, Q_PROBATION, cand);
+}
+
+void *wtinylfu_create(size_t max_bytes)
+{
+  wtinylfu_t *w = Calloc(1, sizeof(wtinylfu_t));
+
+  for (int i = 0; i < 4; i++)
+    w->lists[i] = POLICY_LIST_INIT;
+  w->window_max = max_bytes * WTINYLFU_WINDOW_PCT / 100;
+  w->main_max = max_bytes - w->window_max;
+  w->protected_max = w->main_max * WTINYLFU_PROTECTED_PCT / 100;
+  tinylfu_init(&w->sketch, max_bytes / WTINYLFU_SKETCH_OBJECT);
+  return w;
+}
+
+void wtinylfu_destroy(void *p)
+{
+  wtinylfu_t *w = p;
+
+  policy_nodes_free(&w->nodes);
+  tinylfu_free(&w->sketch);
+  free(w);
+}
+
+void wtinylfu_access(void *p, uint64_t hash)
+{
+  tinylfu_record(&((wtinylfu_t *)p)->sketch, hash);
+}
+
+void wtinylfu_insert(void *p, int index, uint64_t hash, size_t bytes)
+{
+  wtinylfu_t *w = p;
+  policy_node_t *n = policy_node(&w->nodes, index);
+
+  n->hash = hash;
+  n->bytes = bytes;
+  n->queue = Q_NONE;
+  move_to(w, Q_WINDOW, index);
+  spill_window(w);
+}
+
+void wtinylfu_update(void *p, int index, size_t bytes)
+{
+  wtinylfu_t *w = p;
+  policy_node_t *n = &w->nodes.nodes[index];
+  int queue = n->queue;
+
+  policy_list_unlink(&w->nodes, &w->lists[queue], index); // 목록의 byte 수를 옛 크기로 빼고 새 크기로 다시 넣음
+  n->bytes = bytes;
+  move_to(w, queue, index);
+}
+
+void wtinylfu_hit(void *p, int index)
+{
+  wtinylfu_t *w = p;
+  policy_node_t *n = &w->nodes.nodes[index];
+
+  tinylfu_record(&w->sketch, n->hash);
+  if (n->queue == Q_WINDOW)
+  {
+    move_to(w, Q_WINDOW, index);
+    return;
+  }
+  move_to(w, Q_PROTECTED, index);
+  while (w->lists[Q_PROTECTED].bytes > w->protected_max && w->lists[Q_PROTECTED].tail != index)
+    move_to(w, Q_PROBATION, w->lists[Q_PROTECTED].tail);
+}
+
+/* window 가 넘쳐 있으면 그 가장 오래된 것이 main 에 들어가려는 후보. main 의 victim 과 빈도를 비교해서
+   후보가 더 높으면 victim 을, 아니면 후보를 소거함 (victim 이 소거되면 다음 호출에서 후보가 main 에 들어감) */
+int wtinylfu_victim(void *p)
+{
+  wtinylfu_t *w = p;
+  int cand, victim;
+
+  spill_window(w);
+  victim = main_victim(w);
+  if (w->lists[Q_WINDOW].bytes <= w->window_max || (cand = w->lists[Q_WINDOW].tail) < 0)
+    return victim >= 0 ? victim : w->lists[Q_WINDOW].tail;
+  if (victim < 0 || w->nodes.nodes[cand].bytes > w->main_max)
+    return cand;
+  if (tinylfu_estimate(&w->sketch, w->nodes.nodes[cand].hash) >
+      tinylfu_estimate(&w->sketch, w->nodes.nodes[victim].hash))
+    return victim;
+  return cand; // 입장 거절
+}
+
+void wtinylfu_remove(void *p, int index)
+{
+  wtinylfu_t *w = p;
+  policy_node_t *n = &w->nodes.nodes[index];
+
+  policy_list_unlink(&w->nodes, &w->lists[(int)n->queue], index);
+}
+
+POLICY_DEFINE(wtinylfu);
@@ -0,0 +1,29 @@
+/*
+    proxy.h - proxy_cache.c 와 proxy_event.c 가 함께 쓰는 선언
+
+    proxy_cache.c : main, thread pool 모드
+    proxy_event.c : epoll 기반 event loop 모드 (doit 을 상태 머신으로 풀어 쓴 버전)
+*/
+#ifndef __PROXY_H__
+#define __PROXY_H__
+
+#include "csapp.h"
+#include "cache.h"
+
+/* _GNU_SOURCE 를 켜면 csapp.h 의 gai_error 와 netdb.h 선언이 충돌하므로 accept4 만 직접 선언 */
+extern int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+
+#define WEBSERVER_HOST "localhost"
+#define WEBSERVER_PORT 8080
+
+/* 요청 처리 공통 함수 */
+void parse_uri(char *uri, char *hostname, char *path, int *port);
+void build_http_header_buf(char *http_header, char *hostname, char *path, char *client_hdrs);
+void add_conditional_header(char *http_header, cache_fill_t *f);
+extern const char *gateway_timeout_response;
+void send_gateway_timeout(int connfd);
+
+/* event loop 모드. 이 함수를 호출한 thread 가 listenfd 의 모든 연결을 처리하고 돌아오지 않음 */
+void event_loop(int listenfd, Cache *cache);
+
+#endif /* __PROXY_H__ */
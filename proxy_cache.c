@@ -7,14 +7,13 @@
     쓰레드를 무한정 늘릴 수 없음. 서버 사양 & 어떤 작업을 하느냐에 따라 적정량이 있음
  */
 #include <stdio.h>
-#include "csapp.h"
-
-#define WEBSERVER_HOST "localhost"
-#define WEBSERVER_PORT 8080
-
-#define MAX_CACHE_SIZE 1049000
-#define MAX_OBJECT_SIZE 102400
-#define CACHE_SIZE 10
+#include <sched.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include "proxy.h"
+#include "sched.h"
+#include "upstream.h"
+#include "log.h"
 
 static const char *user_agent_hdr =
     "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:10.0.3) Gecko/20120305 "
@@ -30,35 +29,33 @@ static const char *connection_header = "Connection";
 static const char *proxy_connection_header = "Proxy-Connection";
 static const char *user_agent_header = "User-Agent";
 
-void *worker_thread(void *arg);
+/* 웹 서버가 connect / 응답 timeout 안에 답하지 않았을 때 클라이언트에게 보내는 응답 */
+const char *gateway_timeout_response =
+    "HTTP/1.0 504 Gateway Timeout\r\n"
+    "Content-Type: text/plain\r\n"
+    "Content-Length: 24\r\n"
+    "Connection: close\r\n\r\n"
+    "upstream server timeout\n";
+
+void handle_conn(void *job);
+void shed_conn(void *job);
+static void accept_loop(int listenfd);
 void doit(int connfd);
-void parse_uri(char *uri, char *hostname, char *path, int *port);
+static int relay_follower(int connfd, cache_follow_t *fw);
+static void send_entry(int connfd, cache_entry_t *e, size_t sent);
+static void relay_disk(int connfd, cache_fill_t *f);
+static void *refresh_thread(void *arg);
 void build_http_header(char *http_header, char *hostname, char *path, rio_t *client_rio);
-int connect_webserver(char *hostname, int port);
 
-/* caching function */
-void cache_init();
-int cache_find(char *uri);
-void cache_uri(char *uri, char *response_buf);
+Cache shared_cache; // pool/event 모드가 쓰는 캐시. shard 모드는 shard 마다 따로 가짐
 
-typedef struct
-{
-  char cache_obj[MAX_OBJECT_SIZE];
-  char cache_uri[MAXLINE];
-  int eviction_priority; // LRU 알고리즘에 의한 소거 우선순위. 숫자가 작을수록 소거에 대한 우선 순위가 높아짐
-  int is_empty;          // 이 블럭에 캐시 정보가 들었는지 empty인지 아닌지 체크
-  sem_t wmutex;          // cache block 쓰기 lock 여부
-} cache_block;
+#define REFRESH_THREADS 2   // 백그라운드 갱신 thread 수
+#define POOL_MIN_THREADS 4  // pool 모드 worker 수 하한 (-w 로 변경)
+#define POOL_MAX_THREADS 64 // 느린 웹 서버에 worker 가 막혔을 때 늘어날 수 있는 상한
 
-typedef struct
-{
-  cache_block cache_blocks[CACHE_SIZE];
-} Cache;
-
-Cache cache;
-
-#define NTHREADS 10
-#define MAXQUEUE 100
+#define CODEL_TARGET_MS 5     // accept 후 worker 가 잡을 때까지 허용하는 대기 시간
+#define CODEL_INTERVAL_MS 100 // 대기 시간이 이만큼 계속 target 을 넘으면 버리기 시작
+#define RETRY_AFTER_SECS 1    // 503 응답의 Retry-After
 
 /* worker thread 에게 넘길 인자 구조체 */
 typedef struct
@@ -68,91 +65,299 @@ typedef struct
   socklen_t clientlen;
 } thread_arg_t;
 
-/* thread pool 전역 변수 */
-pthread_t thread_pool[NTHREADS];                           // worker thread 수
-thread_arg_t queue[MAXQUEUE];                              // worker thread 에게 넘길 인자 배열
-int queue_head = 0;                                        // 큐에서 제거할 위치
-int queue_tail = 0;                                        // 큐에서 삽입할 위치
-pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;   // 큐 독점 액세스 보장
-pthread_cond_t queue_not_empty = PTHREAD_COND_INITIALIZER; // 큐에 작업이 있고, worker thread에서 작업을 처리할 수 있을때 worker thread에게 알리는 변수
-pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;  // 큐에 여유 공간이 있어서, 작업을 더 받을 수 있음을 알림
+/* 과부하일 때 보내는 503 응답. 버리는 경로에서 sprintf 를 하지 않도록 시작할 때 한 번만 만들어 둠 */
+static char overload_response[256];
+static size_t overload_response_len;
 
-int main(int argc, char **argv)
+/* thread pool. lock-free ring 으로 작업을 넘겨받고 worker 끼리 서로 훔쳐가는 work-stealing scheduler (sched.c) */
+sched_t *thread_pool;
+
+static void usage(char *prog)
 {
-  int listenfd;
-  char hostname[MAXLINE], port[MAXLINE];
-  struct sockaddr_storage clientaddr;
-  socklen_t clientlen;
+  fprintf(stderr, "usage: %s [-m pool|event|shard] [-w min:max] [-n shards] [-P] [-i syscall|uring]\n"
+                  "       [-T connect:firstbyte:idle] [-O host:port=connect:firstbyte:idle] [-q] [-S secs] [-C target:interval|off] [-c bytes] [-s cache_shards]\n"
+                  "       [-p wtinylfu|arc|s3fifo|gdsf] [-d path:bytes] <port>\n", prog);
+  fprintf(stderr, "  -m pool    : accept thread + worker thread pool (기본값)\n");
+  fprintf(stderr, "  -m event   : 단일 thread epoll event loop, non-blocking socket\n");
+  fprintf(stderr, "  -m shard   : core 마다 SO_REUSEPORT listen socket + event loop + 캐시를 따로 가짐\n");
+  fprintf(stderr, "  -w min:max : pool 모드 worker 수 범위 (기본값: %d:%d)\n", POOL_MIN_THREADS, POOL_MAX_THREADS);
+  fprintf(stderr, "  -n shards  : shard 모드의 shard 수 (기본값: online CPU 수)\n");
+  fprintf(stderr, "  -P         : shard thread 를 각자 CPU 하나에 고정\n");
+  fprintf(stderr, "  -i syscall : Rio 가 read()/write() 시스템 콜을 직접 호출 (기본값)\n");
+  fprintf(stderr, "  -i uring   : Rio/Close 를 thread 별 io_uring 으로 처리 (pool 모드)\n");
+  fprintf(stderr, "  -T c:f:i   : 웹 서버 connect / 첫 바이트 / idle timeout (ms, 0 은 제한 없음. 기본값: %d:%d:%d)\n",
+          UPSTREAM_CONNECT_TIMEOUT, UPSTREAM_FIRSTBYTE_TIMEOUT, UPSTREAM_IDLE_TIMEOUT);
+  fprintf(stderr, "  -O h:p=c:f:i : 특정 웹 서버(host:port)에만 적용할 timeout. 여러 번 지정 가능\n");
+  fprintf(stderr, "  -q         : 접속 / 캐시 hit / 요청 로그 끄기\n");
+  fprintf(stderr, "  -S secs    : secs 초마다 accept 속도 (conn/s) 를 stderr 로 출력\n");
+  fprintf(stderr, "  -C t:i     : pool 모드 CoDel. 대기 시간이 i ms 동안 t ms 를 넘으면 503 으로 버림 (기본값: %d:%d, off 로 끔)\n",
+          CODEL_TARGET_MS, CODEL_INTERVAL_MS);
+  fprintf(stderr, "  -c bytes   : 캐시 크기 한도. K/M/G 단위 가능 (shard 모드는 shard 마다. 기본값: %d)\n", MAX_CACHE_SIZE);
+  fprintf(stderr, "  -s n       : 캐시를 uri hash 로 나누는 lock 단위 수 (기본값: %d)\n", CACHE_SHARDS);
+  fprintf(stderr, "  -p policy  : 캐시 소거 정책 (기본값: %s)\n", cache_policy_name());
+  fprintf(stderr, "  -d p:bytes : 메모리에서 소거된 응답을 받아 둘 디스크 tier. log 파일 p (bytes 크기, K/M/G 단위 가능) 와 p.idx\n");
+  exit(1);
+}
+
+/* "64M" 같은 크기 문자열을 byte 수로. 잘못된 값이면 0 */
+static size_t parse_size(char *s)
+{
+  char *end;
+  unsigned long long n = strtoull(s, &end, 10);
+
+  if (*end == 'K' || *end == 'k')
+    n <<= 10, end++;
+  else if (*end == 'M' || *end == 'm')
+    n <<= 20, end++;
+  else if (*end == 'G' || *end == 'g')
+    n <<= 30, end++;
+  return *end == '\0' ? n : 0;
+}
 
-  cache_init();
+/* "path:bytes" 로 디스크 tier 를 엶. 잘못된 값이면 -1, 열지 못하면 종료 */
+static int open_disk(char *arg)
+{
+  char *colon = strrchr(arg, ':');
+  size_t bytes;
 
-  if (argc != 2)
+  if (colon == NULL || colon == arg || (bytes = parse_size(colon + 1)) == 0)
+    return -1;
+  *colon = '\0';
+  if (disk_open(arg, bytes) < 0)
   {
-    fprintf(stderr, "usage: %s <port>\n", argv[0]);
+    fprintf(stderr, "disk tier %s: %s\n", arg, strerror(errno));
     exit(1);
   }
+  return 0;
+}
 
-  // 프로세스가 닫히거나 끊어진 파이프에 쓰기 요청을 할 경우 발생하는 오류(SIGPIPE)를 무시하고 서버를 계속 동작시킬 수 있도록 처리
-  Signal(SIGPIPE, SIG_IGN);
+/* 실행 모드 */
+typedef enum
+{
+  MODE_POOL,  // accept thread 하나 + worker thread pool
+  MODE_EVENT, // event loop thread 하나
+  MODE_SHARD  // core 마다 listen socket / event loop / 캐시를 따로 (shared-nothing)
+} proxy_mode_t;
 
-  listenfd = Open_listenfd(argv[1]);
+/* shard 모드에서 core 하나가 가지는 것들 */
+typedef struct
+{
+  int id;
+  char *port;
+  int pin_cpu; // 고정할 CPU 번호, -1 이면 고정하지 않음
+  Cache *cache;
+  pthread_t tid;
+} shard_t;
+
+/* 호출한 thread 를 cpu 에서만 돌도록 고정. (_GNU_SOURCE 없이 쓰려고 시스템 콜 직접 호출) */
+static void pin_to_cpu(int cpu)
+{
+  unsigned long mask[16] = {0};
+  int bits = 8 * sizeof(unsigned long);
 
-  /* thread pool 초기화 */
-  for (int i = 0; i < NTHREADS; i++)
+  mask[(cpu / bits) % 16] |= 1UL << (cpu % bits);
+  if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) < 0)
+    fprintf(stderr, "sched_setaffinity(cpu %d) error: %s\n", cpu, strerror(errno));
+}
+
+/* shard thread. 자기 SO_REUSEPORT listen socket 의 연결을 자기 event loop 와 캐시로만 처리 */
+static void *shard_thread(void *arg)
+{
+  shard_t *shard = arg;
+
+  if (shard->pin_cpu >= 0)
+    pin_to_cpu(shard->pin_cpu);
+
+  // listen socket 도 shard 마다 따로 열어야 커널이 연결을 shard 별로 나눠줌 (accept 경로에 공유 lock 없음)
+  int listenfd = Open_listenfd_reuseport(shard->port);
+  event_loop(listenfd, shard->cache);
+  return NULL;
+}
+
+/* shard 모드 실행. shard 수만큼 thread 를 만들고 돌아오지 않음 */
+static void run_shards(char *port, int nshards, int pin, size_t cache_bytes)
+{
+  int ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  shard_t *shards = Calloc(nshards, sizeof(shard_t));
+
+  for (int i = 0; i < nshards; i++)
   {
-    Pthread_create(&thread_pool[i], NULL, worker_thread, NULL);
+    shards[i].id = i;
+    shards[i].port = port;
+    shards[i].pin_cpu = pin ? i % ncpus : -1;
+    shards[i].cache = Malloc(sizeof(Cache)); // 캐시도 shard 마다 따로, 다른 core 와 공유하지 않음
+    cache_init(shards[i].cache, cache_bytes, 1); // event loop thread 하나만 쓰므로 나눌 필요 없음
+    Pthread_create(&shards[i].tid, NULL, shard_thread, &shards[i]);
   }
+  for (int i = 0; i < nshards; i++)
+    Pthread_join(shards[i].tid, NULL);
+}
 
-  while (1)
+int main(int argc, char **argv)
+{
+  int listenfd, opt;
+  proxy_mode_t mode = MODE_POOL;
+  int nshards = sysconf(_SC_NPROCESSORS_ONLN), pin = 0;
+  int min_threads = POOL_MIN_THREADS, max_threads = POOL_MAX_THREADS;
+  int rio_backend = RIO_BACKEND_SYSCALL;
+  int verbose = 1, stats_interval = 0;
+  int codel_target = CODEL_TARGET_MS, codel_interval = CODEL_INTERVAL_MS;
+  size_t cache_bytes = MAX_CACHE_SIZE;
+  int cache_shards = CACHE_SHARDS;
+  pthread_t refresh_tid;
+
+  while ((opt = getopt(argc, argv, "m:w:n:Pi:T:O:qS:C:c:s:p:d:")) != -1)
   {
-    clientlen = sizeof(clientaddr);
-    int connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-    Getnameinfo((SA *)&clientaddr, clientlen, hostname, MAXLINE, port, MAXLINE, 0);
-    printf("Accepted connection from (%s %s).\n", hostname, port);
+    if (opt == 'm' && !strcmp(optarg, "pool"))
+      mode = MODE_POOL;
+    else if (opt == 'm' && !strcmp(optarg, "event"))
+      mode = MODE_EVENT;
+    else if (opt == 'm' && !strcmp(optarg, "shard"))
+      mode = MODE_SHARD;
+    else if (opt == 'w' && sscanf(optarg, "%d:%d", &min_threads, &max_threads) == 2 &&
+             min_threads > 0 && max_threads >= min_threads)
+      ;
+    else if (opt == 'n' && atoi(optarg) > 0)
+      nshards = atoi(optarg);
+    else if (opt == 'P')
+      pin = 1;
+    else if (opt == 'i' && !strcmp(optarg, "syscall"))
+      rio_backend = RIO_BACKEND_SYSCALL;
+    else if (opt == 'i' && !strcmp(optarg, "uring"))
+      rio_backend = RIO_BACKEND_URING;
+    else if (opt == 'T' && upstream_set_default(optarg) == 0)
+      ;
+    else if (opt == 'O' && upstream_add_origin(optarg) == 0)
+      ;
+    else if (opt == 'q')
+      verbose = 0;
+    else if (opt == 'S' && atoi(optarg) > 0)
+      stats_interval = atoi(optarg);
+    else if (opt == 'C' && !strcmp(optarg, "off"))
+      codel_target = 0;
+    else if (opt == 'C' && sscanf(optarg, "%d:%d", &codel_target, &codel_interval) == 2 &&
+             codel_target > 0 && codel_interval > 0)
+      ;
+    else if (opt == 'c' && (cache_bytes = parse_size(optarg)) > 0)
+      ;
+    else if (opt == 's' && atoi(optarg) > 0)
+      cache_shards = atoi(optarg);
+    else if (opt == 'p' && cache_set_policy(optarg) == 0)
+      ;
+    else if (opt == 'd' && open_disk(optarg) == 0)
+      ;
+    else
+      usage(argv[0]);
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
 
-    pthread_mutex_lock(&queue_mutex); // connection에 대한 작업을 큐에 쓰기 위해서 큐에 대한 access lock 획득
+  /* 커널이 io_uring 을 지원하지 않으면 기존 시스템 콜 방식으로 동작 */
+  if (rio_set_backend(rio_backend) < 0)
+    fprintf(stderr, "io_uring unavailable, using read()/write()\n");
 
-    /* 큐가 가득 찼을 경우 worker thread를 queue_not_full 신호를 보내기 전까지 wait 시킴 */
-    while ((queue_tail + 1) % MAXQUEUE == queue_head)
-    {
-      pthread_cond_wait(&queue_not_full, &queue_mutex);
-    }
+  /* 접속 로그 (주소 -> 이름 변환, 출력) 는 로그 thread 가 따로 처리 */
+  log_start(verbose, stats_interval);
 
-    /* worker thread가 처리할 인자를 포함한 구조체 초기화 */
-    queue[queue_tail].connfd = connfd;
-    queue[queue_tail].clientaddr = clientaddr;
-    queue[queue_tail].clientlen = clientlen;
-    queue_tail = (queue_tail + 1) % MAXQUEUE; // 큐의 다음 작업 삽입 위치
+  /* 만료 전후의 갱신 (stale-while-revalidate, 미리 갱신) 은 클라이언트를 기다리게 하지 않고 이 thread 들이 받아 옴 */
+  for (int i = 0; i < REFRESH_THREADS; i++)
+    Pthread_create(&refresh_tid, NULL, refresh_thread, NULL);
 
-    pthread_cond_signal(&queue_not_empty); // 큐에 작업 삽입 했으므로 큐에 작업이 있음을 알림
-    pthread_mutex_unlock(&queue_mutex);    // 큐에 관련된 작업 마쳤으므로 lock 반환
+  // 프로세스가 닫히거나 끊어진 파이프에 쓰기 요청을 할 경우 발생하는 오류(SIGPIPE)를 무시하고 서버를 계속 동작시킬 수 있도록 처리
+  Signal(SIGPIPE, SIG_IGN);
+
+  if (mode == MODE_SHARD)
+  {
+    run_shards(argv[optind], nshards, pin, cache_bytes);
+    return 0;
+  }
+
+  cache_init(&shared_cache, cache_bytes, cache_shards);
+  listenfd = Open_listenfd(argv[optind]);
+
+  /* event loop 모드는 이 thread 하나가 모든 client/웹 서버 연결을 처리하고 돌아오지 않음 */
+  if (mode == MODE_EVENT)
+  {
+    event_loop(listenfd, &shared_cache);
+    return 0;
   }
 
+  /* thread pool 초기화. 대기 시간과 막힌 worker 수를 보고 min_threads ~ max_threads 사이에서 크기 조절 */
+  thread_pool = sched_create(min_threads, max_threads, sizeof(thread_arg_t), handle_conn);
+  overload_response_len = snprintf(overload_response, sizeof(overload_response),
+                                   "HTTP/1.0 503 Service Unavailable\r\n"
+                                   "Retry-After: %d\r\n"
+                                   "Content-Type: text/plain\r\n"
+                                   "Content-Length: 20\r\n"
+                                   "Connection: close\r\n\r\n"
+                                   "proxy is overloaded\n",
+                                   RETRY_AFTER_SECS);
+  if (codel_target > 0)
+    sched_set_shed(thread_pool, shed_conn, codel_target, codel_interval);
+
+  accept_loop(listenfd);
   return 0;
 }
 
-void *worker_thread(void *arg)
+/* pool 모드 accept loop. listen socket 을 non-blocking 으로 두고, 깨어날 때마다 backlog 를 EAGAIN 이 날 때까지
+   한꺼번에 accept 해서 넘김. 이름 변환이나 출력은 하지 않음 (log_accept 는 주소 복사만).
+   worker 는 Rio 로 blocking I/O 를 하므로 연결 socket 에는 SOCK_NONBLOCK 을 주지 않음 */
+static void accept_loop(int listenfd)
 {
+  struct pollfd pfd = {listenfd, POLLIN, 0};
+  thread_arg_t thread_arg;
+  int connfd;
+
+  fcntl(listenfd, F_SETFL, fcntl(listenfd, F_GETFL, 0) | O_NONBLOCK);
   while (1)
   {
-    pthread_mutex_lock(&queue_mutex); // 동시성 제어 하기 위해 진입시 lock 획득
+    if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+      unix_error("poll error");
 
-    /* 작업 queue가 비어있는 동안 */
-    while (queue_head == queue_tail)
+    while (1)
     {
-      /* queue_not_empty 신호를 받을때까지, queue_mutex를 이용해서 큐에 대한 접근을 lock하고 대기 */
-      pthread_cond_wait(&queue_not_empty, &queue_mutex);
+      thread_arg.clientlen = sizeof(thread_arg.clientaddr);
+      connfd = accept4(listenfd, (SA *)&thread_arg.clientaddr, &thread_arg.clientlen, SOCK_CLOEXEC);
+      if (connfd < 0)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+          continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+          fprintf(stderr, "accept4 error: %s\n", strerror(errno));
+        break;
+      }
+      log_accept((SA *)&thread_arg.clientaddr, thread_arg.clientlen);
+
+      // lock-free ring 에 값 그대로 복사. 가득 찼으면 기다리지 않고 바로 503 으로 돌려보냄
+      thread_arg.connfd = connfd;
+      if (sched_submit(thread_pool, &thread_arg) < 0)
+        shed_conn(&thread_arg);
     }
+  }
+}
 
-    thread_arg_t thread_arg = queue[queue_head]; // head 위치에서 다음 작업 연결 세부 정보 가져옴
-    queue_head = (queue_head + 1) % MAXQUEUE;    // head 포인터를 증가 시켜 다음 uri작업 대상을 가리킴
+/* worker thread 가 작업(연결) 하나마다 호출 */
+void handle_conn(void *job)
+{
+  thread_arg_t *thread_arg = job;
 
-    pthread_cond_signal(&queue_not_full); // 큐에 공간이 있음을 queue_not_full 조건 변수에 신호 보냄
-    pthread_mutex_unlock(&queue_mutex);   // 큐의 동시성과 관련된 로직 종료되었으므로 lock 반환
+  doit(thread_arg->connfd);
+  Close(thread_arg->connfd);
+}
 
-    doit(thread_arg.connfd);
-    Close(thread_arg.connfd);
-  }
+/* 과부하로 버리는 연결. 미리 만들어 둔 503 을 보내고 닫음.
+   받지 않은 요청이 socket 에 남아 있으면 close 가 RST 를 보내 503 을 지워버리므로, 남은 만큼 비우고 닫음 */
+void shed_conn(void *job)
+{
+  thread_arg_t *thread_arg = job;
+  char drain[MAXLINE];
+
+  send(thread_arg->connfd, overload_response, overload_response_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  shutdown(thread_arg->connfd, SHUT_WR);
+  while (recv(thread_arg->connfd, drain, sizeof(drain), MSG_DONTWAIT) > 0)
+    ;
+  close(thread_arg->connfd);
+  log_shed();
 }
 
 void doit(int connfd)
@@ -162,7 +367,7 @@ void doit(int connfd)
   char webserver_http_header[MAXLINE];
   char hostname[MAXLINE], path[MAXLINE];
 
-  rio_t rio, server_rio;
+  rio_t rio;
 
   Rio_readinitb(&rio, connfd);
   Rio_readlineb(&rio, buf, MAXLINE);
@@ -176,94 +381,288 @@ void doit(int connfd)
     return;
   }
 
-  /* 요청 uri 주소가 캐싱되어 있는 주소 인지 */
-  int cache_index;
-  if ((cache_index = cache_find(uri)) != -1)
+  /* 요청 uri 주소가 캐싱되어 있는 주소 인지. 없으면 같은 uri 를 받아 오는 중인 요청에 붙거나 직접 받아 옴 */
+  cache_entry_t *hit;
+  cache_fill_t fill;
+  cache_follow_t follow;
+  size_t sent;
+  int rc, role;
+  while ((rc = cache_send(&shared_cache, uri, connfd, &hit, &sent)) < 0 &&
+         (role = cache_fill_start(&shared_cache, uri, &fill, &follow)) < 0)
+    ; // 그 사이에 캐싱이 끝남. 다시 조회
+  if (rc >= 0)
   {
-    // 캐시에서 찾은 값을 connfd에 쓰고, 캐시에서 그 값을 바로 보내게 됨
-    cache.cache_blocks[cache_index].eviction_priority = CACHE_SIZE;                                                   // 가장 최근 읽혔으므로, 소거 우선 순위 가장 낮게
-    update_cache_eviction_priority(cache_index);                                                                      // 나머지 cache block 소거 우선 순위 증가
-    Rio_writen(connfd, cache.cache_blocks[cache_index].cache_obj, strlen(cache.cache_blocks[cache_index].cache_obj)); // 클라이언트에게 캐싱 데이터 응답
+    // 캐시에서 바로 보냄. 클라이언트가 느려서 다 못 보냈으면 참조를 잡은 응답을 lock 없이 마저 보냄
+    if (rc == 1)
+      send_entry(connfd, hit, sent);
+    return;
+  }
+  if (role == 1 && !relay_follower(connfd, &follow))
+    return;
+  if (role == 1) // 공유하면 안 되는 응답이었음. 캐싱하지 않고 직접 받아 옴
+    cache_fill_pass(&fill);
+  else if (cache_fill_disk(&fill)) // 디스크 tier 로 내려간 응답. 웹 서버 대신 디스크에서 읽음
+  {
+    relay_disk(connfd, &fill);
     return;
   }
-
-  char uri_copy[1000];
-  strcpy(uri_copy, uri);
   parse_uri(uri, hostname, path, &port);                          // uri 로부터 hostname, path, port 파싱하여 변수에 할당
   build_http_header(webserver_http_header, hostname, path, &rio); // hostname, path, port와 클라이언트 요청을 기반으로 웹 서버에 전송할 요청 헤더 재구성
+  add_conditional_header(webserver_http_header, &fill);          // 캐시의 만료된 응답을 재검증하는 요청이면 validator 를 붙임
 
-  web_connfd = connect_webserver(hostname, port); // 소켓 생성, 웹 서버와 연결
+  upstream_timeouts_t timeouts;
+  upstream_timeouts(hostname, port, &timeouts);         // 이 웹 서버에 적용할 connect / 첫 바이트 / idle timeout
+  web_connfd = upstream_connect(hostname, port, &timeouts); // 소켓 생성, connect timeout 안에 웹 서버와 연결
   if (web_connfd < 0)
   {
     printf("connection failed\n");
+    if ((hit = cache_fill_error(&fill)) != NULL) // 재검증하던 응답이 stale-if-error 기간이면 그것을 대신 보냄
+      send_entry(connfd, hit, 0);
+    else if (web_connfd == -3)
+      send_gateway_timeout(connfd);
     return;
   }
 
-  Rio_readinitb(&server_rio, web_connfd);
   Rio_writen(web_connfd, webserver_http_header, strlen(webserver_http_header)); // 웹 서버로 재구성한 요청 헤더를 전송
+  rio_flush(); // io_uring 이면 미뤄 둔 쓰기를 poll 로 기다리기 전에 내보냄
 
-  char response_buf[MAX_OBJECT_SIZE];
-  int size_buf = 0;
-  size_t n;
+  int aborted = 0;     // timeout 이나 읽기 실패로 끊긴 응답
+  int timed_out = 0;   // 아무것도 받지 못하고 timeout
+  int client_gone = 0; // 클라이언트가 끊음. 붙어 있는 follower 가 있으면 끝까지 받음
+  ssize_t n;
 
-  /* 웹 서버 응답을 한 줄씩 읽어서 클라이언트에게 전달 */
-  while ((n = Rio_readlineb(&server_rio, buf, MAXLINE)) != 0)
+  /* 웹 서버 응답을 캐시 segment 에 바로 읽어 들이고, 같은 byte 를 그 자리에서 클라이언트에게 전달.
+     첫 바이트까지는 firstbyte, 그 뒤로는 idle timeout 적용 */
+  while (1)
   {
-    // printf("proxy received %ld bytes, then send\n", n);
-    size_buf += n;
-    /* proxy거쳐서 서버에서 response오는데, 그 응답을 저장하고 클라이언트에 보냄 */
-    if (size_buf < MAX_OBJECT_SIZE) // response_buf에 제한 두지 않고 계속 쓰다보면 buffer overflow 발생
-      strcat(response_buf, buf);
-    Rio_writen(connfd, buf, n);
+    int wait_ms = fill.len == 0 ? timeouts.firstbyte_ms : timeouts.idle_ms;
+    char *p;
+    size_t room, len;
+
+    /* io_uring 이면 rio_writen 은 미뤄 두었다가 다음 쓰기 때 내보냄. 기다리기 전에 내보내야 클라이언트가 다음 조각까지 기다리지 않음 */
+    if (!client_gone && rio_flush() < 0)
+      client_gone = 1;
+    if (!upstream_wait_readable(web_connfd, wait_ms))
+    {
+      printf("upstream timeout (%s:%d)\n", hostname, port);
+      timed_out = fill.len == 0;
+      aborted = 1;
+      break;
+    }
+    p = cache_fill_buf(&fill, &room);
+    if ((n = read(web_connfd, p, room)) < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      aborted = 1; // 읽기 실패. 끊긴 응답
+    if (n <= 0)
+      break;
+    len = cache_fill_commit(&fill, n, &p); // 재검증 중이면 304 인지 알 때까지 0
+    if (len > 0 && !client_gone && rio_writen(connfd, p, len) != len)
+      client_gone = 1;
+    if (client_gone && !cache_fill_shared(&fill))
+    {
+      aborted = 1;
+      break;
+    }
   }
 
   Close(web_connfd);
 
-  /* 저장된 response_buf의 크기가 cache block에 저장될 수 있는 최대 크기보다 작을때만 캐싱 */
-  if (size_buf < MAX_OBJECT_SIZE)
-    cache_uri(uri_copy, response_buf);
+  /* MAX_OBJECT_SIZE 보다 작게 끝난 응답만 캐싱. 중간에 끊긴 응답은 캐싱하지 않음.
+     재검증한 응답이 304 였거나, 재검증 중에 웹 서버가 실패했는데 stale-if-error 기간이면 캐시의 응답을 보냄 */
+  hit = aborted ? cache_fill_error(&fill) : cache_fill_finish(&fill);
+  if (hit == NULL && timed_out)
+    send_gateway_timeout(connfd);
+  else if (hit != NULL && client_gone)
+    cache_release(hit);
+  else if (hit != NULL)
+    send_entry(connfd, hit, 0);
 }
 
-void build_http_header(char *http_header, char *hostname, char *path, rio_t *client_rio)
+/* 백그라운드 갱신 thread. 캐시가 요청한 uri (stale-while-revalidate, 미리 갱신) 를 클라이언트 없이 받아 와서
+   캐시의 응답을 갱신함. 모든 모드가 같이 씀 */
+static void *refresh_thread(void *arg)
 {
-  char buf[MAXLINE], request_line[MAXLINE], other_hdr[MAXLINE], host_hdr[MAXLINE];
-  /* request line 생성 */
-  sprintf(request_line, request_line_hdr_format, path);
+  char uri[MAXLINE], hostname[MAXLINE], path[MAXLINE], http_header[MAXLINE];
+  upstream_timeouts_t timeouts;
+  cache_fill_t fill;
+  cache_entry_t *e;
+  int fd, port, failed;
+  ssize_t n;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    cache_refresh_next(&fill, uri, sizeof(uri));
+    strcpy(path, "/");
+    parse_uri(uri, hostname, path, &port);
+    build_http_header_buf(http_header, hostname, path, "");
+    add_conditional_header(http_header, &fill);
+
+    upstream_timeouts(hostname, port, &timeouts);
+    fd = upstream_connect(hostname, port, &timeouts);
+    failed = fd < 0 || rio_writen(fd, http_header, strlen(http_header)) < 0 || rio_flush() < 0;
+    while (!failed)
+    {
+      char *p;
+      size_t room;
+
+      if (!upstream_wait_readable(fd, fill.len == 0 ? timeouts.firstbyte_ms : timeouts.idle_ms))
+      {
+        failed = 1;
+        break;
+      }
+      p = cache_fill_buf(&fill, &room);
+      if ((n = read(fd, p, room)) < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+      {
+        failed = n < 0;
+        break;
+      }
+      cache_fill_commit(&fill, n, &p); // 보낼 클라이언트가 없음
+    }
+    if (fd >= 0)
+      Close(fd);
 
-  /* 클라이언트 입력 스트림 버퍼를 한 줄씩 읽어서 HTTP header를 만듦 */
-  while (Rio_readlineb(client_rio, buf, MAXLINE) > 0)
+    /* 실패해도 stale-if-error 기간이면 캐시의 응답은 그대로 둠 */
+    e = failed ? cache_fill_error(&fill) : cache_fill_finish(&fill);
+    if (e != NULL)
+      cache_release(e);
+  }
+  return NULL;
+}
+
+/* 디스크 tier 에서 읽는 대로 클라이언트에 보내고 메모리 캐시로 다시 올림. 클라이언트가 끊어도 끝까지 읽음 (follower 와 캐싱을 위해) */
+static void relay_disk(int connfd, cache_fill_t *f)
+{
+  int client_gone = 0;
+  ssize_t n;
+  char *p;
+
+  while ((n = cache_fill_disk_next(f, &p)) > 0)
+    if (!client_gone && rio_writen(connfd, p, n) != n)
+      client_gone = 1;
+  if (n < 0) // 읽는 사이에 log 가 덮어씀
+    cache_fill_abort(f);
+  else
+    cache_fill_finish(f);
+}
+
+/* 참조를 잡은 캐시의 응답을 sent 번째 byte 부터 끝까지 보내고 참조를 놓음 */
+static void send_entry(int connfd, cache_entry_t *e, size_t sent)
+{
+  ssize_t n;
+
+  while (sent < CACHE_ENTRY_LEN(e) && ((n = cache_entry_send(e, connfd, sent, 0)) > 0 || errno == EINTR))
+    if (n > 0)
+      sent += n;
+  cache_release(e);
+}
+
+/* 같은 uri 를 받아 오는 중인 요청 (leader) 이 받는 대로 클라이언트에 전달. leader 가 실패했으면
+   아직 아무것도 못 보냈을 때만 504. 공유하면 안 되는 응답이라 직접 받아 와야 하면 1 */
+static int relay_follower(int connfd, cache_follow_t *fw)
+{
+  char *p;
+  ssize_t n;
+
+  while ((n = cache_follow_next(fw, &p, NULL)) > 0)
   {
-    if (strcmp(buf, end_of_hdr) == 0)
+    if (rio_writen(connfd, p, n) != n)
       break;
+    cache_follow_advance(fw, n);
+  }
+  cache_follow_release(fw);
+  if (n == CACHE_FOLLOW_PASS)
+    return 1;
+  if (n < 0 && fw->pos == 0)
+    send_gateway_timeout(connfd);
+  return 0;
+}
 
-    /* 대소문자 여부 상관 없이 비교 if true -> return 0 */
-    if (!strncasecmp(buf, host_header, strlen(host_header)))
-    {
-      strcpy(host_hdr, buf);
-      continue;
-    }
+/* 504 응답. 클라이언트가 이미 끊었을 수 있으므로 쓰기 실패는 무시 */
+void send_gateway_timeout(int connfd)
+{
+  rio_writen(connfd, (void *)gateway_timeout_response, strlen(gateway_timeout_response));
+}
 
-    /* 기타 헤더 정보 */
-    if (!strncasecmp(buf, connection_header, strlen(connection_header)) &&
-        !strncasecmp(buf, proxy_connection_header, strlen(proxy_connection_header)) &&
-        !strncasecmp(buf, user_agent_header, strlen(user_agent_header)))
-    {
-      strcat(other_hdr, buf);
-    }
+/* 클라이언트 요청 헤더 한 줄을 보고 Host 헤더나 기타 헤더로 분류 */
+static void add_client_header(char *line, char *host_hdr, char *other_hdr)
+{
+  /* 대소문자 여부 상관 없이 비교 if true -> return 0 */
+  if (!strncasecmp(line, host_header, strlen(host_header)))
+  {
+    strcpy(host_hdr, line);
+    return;
   }
+
+  /* 기타 헤더 정보 */
+  if (!strncasecmp(line, connection_header, strlen(connection_header)) &&
+      !strncasecmp(line, proxy_connection_header, strlen(proxy_connection_header)) &&
+      !strncasecmp(line, user_agent_header, strlen(user_agent_header)))
+  {
+    strcat(other_hdr, line);
+  }
+}
+
+/* request line 과 분류된 헤더들로 웹 서버에 보낼 HTTP header 완성 */
+static void finish_http_header(char *http_header, char *hostname, char *path, char *host_hdr, char *other_hdr)
+{
+  char request_line[MAXLINE];
+  /* request line 생성 */
+  sprintf(request_line, request_line_hdr_format, path);
+
   if (strlen(host_hdr) == 0)
     sprintf(host_hdr, host_hdr_format, hostname);
   sprintf(http_header, "%s%s%s%s%s%s%s", request_line, host_hdr, conn_hdr,
           prox_hdr, user_agent_hdr, other_hdr, end_of_hdr);
+}
+
+void build_http_header(char *http_header, char *hostname, char *path, rio_t *client_rio)
+{
+  char buf[MAXLINE], other_hdr[MAXLINE] = "", host_hdr[MAXLINE] = "";
+
+  /* 클라이언트 입력 스트림 버퍼를 한 줄씩 읽어서 HTTP header를 만듦 */
+  while (Rio_readlineb(client_rio, buf, MAXLINE) > 0)
+  {
+    if (strcmp(buf, end_of_hdr) == 0)
+      break;
+    add_client_header(buf, host_hdr, other_hdr);
+  }
+  finish_http_header(http_header, hostname, path, host_hdr, other_hdr);
   printf("%s\n", http_header);
 
   return;
 }
-int connect_webserver(char *hostname, int port)
+
+/* 이미 메모리에 읽어둔 요청 헤더(request line 다음 줄부터)로 HTTP header를 만듦. event loop 모드용 */
+void build_http_header_buf(char *http_header, char *hostname, char *path, char *client_hdrs)
 {
-  char port_str[100];
-  sprintf(port_str, "%d", port);
-  return Open_clientfd(hostname, port_str);
+  char line[MAXLINE], other_hdr[MAXLINE] = "", host_hdr[MAXLINE] = "";
+  char *pos = client_hdrs, *eol;
+
+  while ((eol = strstr(pos, "\r\n")) != NULL && eol != pos)
+  {
+    size_t len = eol - pos + 2;
+    if (len >= MAXLINE)
+      len = MAXLINE - 1;
+    memcpy(line, pos, len);
+    line[len] = '\0';
+    add_client_header(line, host_hdr, other_hdr);
+    pos = eol + 2;
+  }
+  finish_http_header(http_header, hostname, path, host_hdr, other_hdr);
+}
+
+/* 캐시의 만료된 응답을 재검증하는 leader 면 요청 헤더 끝 (빈 줄 앞) 에 If-None-Match / If-Modified-Since 를 붙임 */
+void add_conditional_header(char *http_header, cache_fill_t *f)
+{
+  size_t len = strlen(http_header) - strlen(end_of_hdr);
+  size_t n = cache_fill_conditional(f, http_header + len, MAXLINE - len - strlen(end_of_hdr));
+
+  if (n > 0)
+    strcpy(http_header + len + n, end_of_hdr);
 }
 
 /* 요청된 uri로부터 hostname, path, port를 parsing */
@@ -296,91 +695,3 @@ void parse_uri(char *uri, char *hostname, char *path, int *port)
   }
   return;
 }
-
-/* 캐시 초기화 함수 */
-void cache_init()
-{
-  for (int i = 0; i < CACHE_SIZE; i++)
-  {
-    cache.cache_blocks[i].eviction_priority = 0; // 아직 캐싱된 데이터 없으므로 0, 최근에 할당 된 cache block 일 수록 높은 값을 가짐
-    cache.cache_blocks[i].is_empty = 1;          // 아직 캐싱된 데이터 없으므로 1
-
-    // 두번째 파라미터 1이면 process shared, 0이면 thread shared, 세번째 파라미터 -> 세마포어 초기값 1(액세스 가능)
-    Sem_init(&cache.cache_blocks[i].wmutex, 0, 1); // -> 진입 가능한 자원 1개뿐이므로 binary semaphore
-  }
-}
-
-/* cache 에서 요청 uri와 일치하는 uri를 가지고 있는 cache block을 탐색하여 해당 block의 index 반환 */
-int cache_find(char *uri)
-{
-  printf("\ncache hit ! ====> %s\n", uri);
-  for (int i = 0; i < CACHE_SIZE; i++)
-  {
-    P(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 획득
-    /* cache block 이 empty 가 아니고, cache block에 있는 uri이 현재 요청 uri과 일치한다면 cache block의 index 반환 */
-    if (strcmp(uri, cache.cache_blocks[i].cache_uri) == 0)
-    {
-      V(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 반환
-      return i;
-    }
-    V(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 반환
-  }
-  return -1;
-}
-
-/* eviction_priority 알고리즘에 따라 최소 eviction_priority 값을 갖는 cache block의 index 찾아 반환 */
-int cache_eviction()
-{
-  int min = CACHE_SIZE;
-  int minindex = 0;
-  for (int i = 0; i < CACHE_SIZE; i++)
-  {
-    P(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 획득
-    /* cache block empty 라면 해당 block의 index를 반환 */
-    if (cache.cache_blocks[i].is_empty == 1) // 비어 있는 cache block 있다면, 해당 블록 인덱스 반환
-    {
-      V(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 반환
-      return i;
-    }
-    /* eviction_priority가 현재 최솟값 min 보다 작다면 eviction_priority 값을 갱신 해주면서 최소 cache block 탐색*/
-    if (cache.cache_blocks[i].eviction_priority < min)
-    {
-      minindex = i;                                  // i로 minindex 갱신
-      min = cache.cache_blocks[i].eviction_priority; // min은 i번째 cache block의 eviction_priority 값으로 갱신
-    }
-    V(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 반환
-  }
-  return minindex;
-}
-
-void update_cache_eviction_priority(int index)
-{
-  for (int i = 0; i < CACHE_SIZE; i++)
-  {
-    if (i == index)
-      continue;
-
-    P(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 획득
-
-    if (cache.cache_blocks[i].is_empty == 0)
-      cache.cache_blocks[i].eviction_priority--; // 최근 캐싱된 cache block을 제외한 나머지 cache block eviction_priority 값을 감소 시킴
-
-    V(&cache.cache_blocks[i].wmutex); // cache block 쓰기 lock 반환
-  }
-}
-
-/* empty cache block에 uri 캐싱 */
-void cache_uri(char *uri, char *response_buf)
-{
-  int index = cache_eviction(); // 빈 캐시 블럭을 찾는 첫번째 index
-
-  P(&cache.cache_blocks[index].wmutex); // cache block 쓰기 lock 획득
-
-  strcpy(cache.cache_blocks[index].cache_obj, response_buf); // 웹 서버 응답 값을 캐시 블록에 저장
-  strcpy(cache.cache_blocks[index].cache_uri, uri);          // 클라이언트의 요청 uri를 캐시 블록에 저장
-  cache.cache_blocks[index].is_empty = 0;                    // 캐시 블록 할당 되었으므로 0으로 변경
-  cache.cache_blocks[index].eviction_priority = CACHE_SIZE;  // 가장 최근 캐싱 되었으므로, 가장 큰 값 부여
-  update_cache_eviction_priority(index);                     // 기존 나머지 캐시 블록들의 eviction_priority 값을 낮추어서 eviction 우선 순위를 높임
-
-  V(&cache.cache_blocks[index].wmutex); // cache block 쓰기 lock 반환
-}
\ No newline at end of file
@@ -0,0 +1,645 @@
+/*
+    epoll 기반 event loop 모드
+
+    thread pool 모드는 연결 하나당 worker thread 하나가 Rio_readlineb 에서 block 되기 때문에
+    동시 연결 수 = thread 수. thread 가 늘수록 context switching 비용이 CPU 보다 먼저 한계가 됨.
+    (thread 마다 스택 수 MB, doit() 의 스택 배열만 100KB 이상)
+
+    event loop 모드는 thread 하나가 모든 client / 웹 서버 socket 을 non-blocking 으로 들고 있고,
+    연결 하나를 stackless coroutine (co.h) 하나로 처리함. conn_run() 은 doit() 과 같은 순서로
+    위에서 아래로 읽히지만, socket 이 EAGAIN 이면 그 자리에서 멈췄다가 이벤트가 오면 이어서 진행함.
+
+      요청 헤더 읽기 -> (cache hit) -> 캐시 데이터 전송
+                     -> (cache miss) -> connect -> 요청 전송 -> 응답 중계 -> 캐싱
+
+    yield 를 넘어 유지해야 하는 값은 전부 conn_t (coroutine frame) 에 있고,
+    버퍼는 필요한 단계에서 필요한 만큼만 할당하므로 연결 하나당 수 KB.
+
+    epoll 은 edge-triggered 로 client/웹 서버 fd 를 IN|OUT 으로 한 번만 등록하고,
+    이벤트가 오면 coroutine 을 EAGAIN 이 날 때까지 진행시킴 (epoll_ctl MOD 호출 없음).
+
+    웹 서버 쪽 connect / 첫 바이트 / idle timeout 은 loop 마다 하나인 timing wheel (timer.c) 로 처리.
+    연결마다 timer 하나를 두고 단계가 바뀌거나 데이터가 오갈 때마다 다시 걸어둠.
+    timeout 이 나면 coroutine 을 cancel 해서 멈춰 있던 곳에서 바로 timeout 처리로 넘어감.
+
+    follower 는 보통 같은 loop 의 leader 가 깨우지만, 백그라운드 갱신 thread 가 leader 인 응답에 붙으면
+    그 thread 가 remote_ready 에 넣고 eventfd 로 loop 를 깨움.
+    웹 서버 주소 조회 (getaddrinfo) 도 resolver thread (upstream.c) 가 하고 같은 방법으로 loop 를 깨움.
+*/
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "proxy.h"
+#include "co.h"
+#include "timer.h"
+#include "upstream.h"
+#include "log.h"
+
+#define MAX_EVENTS 1024
+#define TIMER_TICK_MS 10
+#define REQ_INIT_SIZE 512 // 요청 헤더 버퍼 처음 크기. 모자라면 MAXLINE 까지 두 배씩
+
+typedef struct conn conn_t;
+
+/* event loop 하나의 상태. shard 모드에서는 core 마다 하나씩 돌아감 */
+typedef struct
+{
+  int epfd;
+  int listenfd;
+  Cache *cache;         // 이 loop 가 쓰는 캐시
+  conn_t *closed_conns; // 이번 epoll_wait 결과 처리가 끝나면 해제할 연결들
+  timer_wheel_t timers; // 연결별 웹 서버 timeout
+  conn_t *ready_conns;  // leader 가 새 데이터를 받아서 다시 진행할 follower 들
+  pthread_t tid;        // loop 를 돌리는 thread
+  int wakefd;           // 다른 thread 의 leader 가 follower 를 깨웠음 (eventfd)
+  pthread_mutex_t remote_lock;
+  conn_t *remote_ready; // 다른 thread 의 leader 가 깨운 follower 들, 주소 조회가 끝난 연결들 (remote_lock 으로 보호)
+} loop_t;
+
+/* epoll_event.data.ptr 가 가리키는 대상. 어떤 연결의 어떤 fd 인지 구분 (conn == NULL 이면 listen socket 이나 wakefd) */
+typedef struct
+{
+  conn_t *conn;
+  int fd;
+} ev_handle_t;
+
+/* 연결 하나의 coroutine frame */
+struct conn
+{
+  co_t co;
+  loop_t *loop;
+  int closed;
+  ev_handle_t client; // 클라이언트 연결
+  ev_handle_t server; // 웹 서버 연결 (-1 이면 아직 없음)
+
+  char *req; // 클라이언트 요청 헤더 누적
+  size_t req_len, req_cap;
+  char *uri; // 캐싱 key 로 쓸 요청 uri 원본
+
+  char *http_header; // 웹 서버로 보낼 요청 헤더
+  size_t header_len;
+
+  char *buf; // 웹 서버 -> 클라이언트로 중계 중인 조각 (fill 의 segment 안)
+  size_t buf_len;
+
+  cache_entry_t *hit; // 캐시 hit 인데 한 번에 다 못 보냈을 때 참조를 잡은 응답
+  cache_fill_t fill;  // miss (leader) 일 때 웹 서버 응답을 받는 캐시 segment. fill.len 이 0 이면 아직 첫 바이트 전
+  int client_gone;    // leader 의 클라이언트가 끊음. follower 가 남아 있으면 끝까지 받음
+  cache_follow_t follow;  // 같은 uri 를 받아 오는 중인 연결 (leader) 에 붙은 follower 일 때 읽는 위치
+  cache_waiter_t waiter;  // follower 가 새 데이터를 기다림
+  int ready;              // ready_conns 에 들어 있는지
+  conn_t *next_ready;
+  int remote;             // remote_ready 에 들어 있는지 (remote_lock 으로 보호)
+  conn_t *next_remote;
+  size_t sent;        // 지금 쓰고 있는 버퍼에서 이미 보낸 바이트 수
+
+  upstream_resolve_t resolve;        // 웹 서버 주소 조회 (resolve.addrs 가 주소 목록)
+  int resolving;                     // 조회가 resolver thread 에 있음. 끝나기 전에는 해제하지 않음 (remote_lock 으로 보호)
+  struct addrinfo *cur_addr;         // 지금 connect 시도 중인 주소
+  upstream_timeouts_t timeouts;      // 이 웹 서버에 적용할 timeout
+  tw_timer_t timer;
+  conn_t *next_closed; // 해제 대기 목록
+};
+
+/* buf 의 [sent, len) 을 모두 쓸 때까지. 실패하면 n < 0 */
+#define AWAIT_WRITE_ALL(co, n, fd, buf, len, sent)                 \
+  for ((sent) = 0, (n) = 0; (sent) < (len); (sent) += (n))         \
+  {                                                                \
+    CO_AWAIT_IO(co, n, write(fd, (buf) + (sent), (len) - (sent))); \
+    if ((n) < 0)                                                   \
+      break;                                                       \
+  }
+
+static int conn_run(conn_t *c);
+static void conn_close(conn_t *c);
+
+/* 지금부터 ms 뒤에 timeout. 0 이면 제한 없음 */
+static void conn_arm(conn_t *c, int ms)
+{
+  if (ms > 0)
+    tw_add(&c->loop->timers, &c->timer, tw_now_ms() + ms);
+  else
+    tw_del(&c->loop->timers, &c->timer);
+}
+
+/* 웹 서버가 timeout 안에 답하지 않음. 멈춰 있던 coroutine 을 cancel 해서 timeout 처리로 넘김 */
+static void conn_timeout(tw_timer_t *t, void *arg)
+{
+  conn_t *c = arg;
+
+  if (c->closed)
+    return;
+  c->co.cancelled = 1;
+  if (conn_run(c) < 0)
+    conn_close(c);
+}
+
+/* fd 를 edge-triggered 로 읽기/쓰기 모두 감시하도록 등록 */
+static void watch_fd(loop_t *loop, ev_handle_t *h)
+{
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.ptr = h;
+  if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, h->fd, &ev) < 0)
+    unix_error("epoll_ctl error");
+}
+
+/* 연결 종료. 같은 epoll_wait 결과 안에 이 연결의 이벤트가 더 남아있을 수 있으므로 메모리 해제는 미룸 */
+static void conn_close(conn_t *c)
+{
+  if (c->closed)
+    return;
+  c->closed = 1;
+  tw_del(&c->loop->timers, &c->timer);
+  if (c->hit != NULL)
+  {
+    cache_release(c->hit);
+    c->hit = NULL;
+  }
+  cache_fill_abort(&c->fill); // 아직 받는 중이던 leader 면 follower 들에게 실패를 알림
+  cache_follow_release(&c->follow);
+  close(c->client.fd); // close 하면 epoll 감시 목록에서도 빠짐
+  if (c->server.fd >= 0)
+    close(c->server.fd);
+  c->next_closed = c->loop->closed_conns;
+  c->loop->closed_conns = c;
+}
+
+static void free_closed_conns(loop_t *loop)
+{
+  conn_t *done = NULL, *pending = NULL;
+
+  /* 닫기 전에 다른 thread 가 깨워 둔 연결은 remote_ready 에서 뺌 (닫은 뒤에는 깨우지 않음: cache_follow_release).
+     주소 조회가 아직 resolver thread 에 있는 연결은 끝날 때까지 남겨 둠 (끝나면 remote_ready 로 loop 를 깨움) */
+  if (loop->closed_conns == NULL)
+    return;
+  pthread_mutex_lock(&loop->remote_lock);
+  for (conn_t **pp = &loop->remote_ready; *pp != NULL;)
+    if ((*pp)->closed)
+      *pp = (*pp)->next_remote;
+    else
+      pp = &(*pp)->next_remote;
+  while (loop->closed_conns != NULL)
+  {
+    conn_t *c = loop->closed_conns;
+    loop->closed_conns = c->next_closed;
+    c->next_closed = c->resolving ? pending : done;
+    *(c->resolving ? &pending : &done) = c;
+  }
+  loop->closed_conns = pending;
+  pthread_mutex_unlock(&loop->remote_lock);
+
+  while (done != NULL)
+  {
+    conn_t *c = done;
+    done = c->next_closed;
+    if (c->resolve.addrs != NULL)
+      freeaddrinfo(c->resolve.addrs);
+    free(c->req);
+    free(c->uri);
+    free(c->http_header);
+    free(c);
+  }
+}
+
+static void set_ready(conn_t *c)
+{
+  if (c->ready)
+    return;
+  c->ready = 1;
+  c->next_ready = c->loop->ready_conns;
+  c->loop->ready_conns = c;
+}
+
+/* 다른 thread 에서 c 를 remote_ready 에 넣고 loop 를 깨움. resolved 면 주소 조회가 끝났다고 표시 (그 뒤로 c 는 해제될 수 있음) */
+static void wake_remote(conn_t *c, int resolved)
+{
+  loop_t *loop = c->loop;
+  uint64_t one = 1;
+
+  pthread_mutex_lock(&loop->remote_lock);
+  if (resolved)
+    c->resolving = 0;
+  if (!c->remote)
+  {
+    c->remote = 1;
+    c->next_remote = loop->remote_ready;
+    loop->remote_ready = c;
+  }
+  pthread_mutex_unlock(&loop->remote_lock);
+  if (write(loop->wakefd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    unix_error("eventfd write error");
+}
+
+/* leader 가 새 데이터를 받음. 이번 이벤트 처리가 끝나면 이어서 진행.
+   leader 가 다른 thread (백그라운드 갱신) 면 remote_ready 에 넣고 loop 를 깨움 */
+static void conn_wake(cache_waiter_t *w)
+{
+  conn_t *c = (conn_t *)((char *)w - offsetof(conn_t, waiter));
+
+  if (pthread_equal(c->loop->tid, pthread_self()))
+    set_ready(c);
+  else
+    wake_remote(c, 0);
+}
+
+/* resolver thread 가 주소 조회를 끝냄 */
+static void conn_resolved(upstream_resolve_t *r)
+{
+  wake_remote((conn_t *)((char *)r - offsetof(conn_t, resolve)), 1);
+}
+
+/* 다른 thread 가 깨운 follower 들을 ready_conns 로 옮김 */
+static void take_remote_ready(loop_t *loop)
+{
+  uint64_t n;
+
+  while (read(loop->wakefd, &n, sizeof(n)) < 0 && errno == EINTR)
+    ;
+  pthread_mutex_lock(&loop->remote_lock);
+  for (conn_t *c = loop->remote_ready; c != NULL; c = c->next_remote)
+  {
+    c->remote = 0;
+    set_ready(c);
+  }
+  loop->remote_ready = NULL;
+  pthread_mutex_unlock(&loop->remote_lock);
+}
+
+static void run_ready_conns(loop_t *loop)
+{
+  while (loop->ready_conns != NULL)
+  {
+    conn_t *c = loop->ready_conns;
+    loop->ready_conns = c->next_ready;
+    c->ready = 0;
+    if (!c->closed && conn_run(c) < 0)
+      conn_close(c);
+  }
+}
+
+/* listen socket 에 쌓인 연결을 EAGAIN 이 날 때까지 모두 accept */
+static void accept_conns(loop_t *loop)
+{
+  struct sockaddr_storage clientaddr;
+  socklen_t clientlen;
+  int connfd;
+
+  while (1)
+  {
+    clientlen = sizeof(clientaddr);
+    connfd = accept4(loop->listenfd, (SA *)&clientaddr, &clientlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (connfd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        log_msg(1, "accept4 error: %s\n", strerror(errno));
+      return;
+    }
+
+    // 이름 변환과 출력은 로그 thread 가 함. event loop 는 주소만 넘기고 바로 다음 연결로
+    log_accept((SA *)&clientaddr, clientlen);
+
+    conn_t *c = Calloc(1, sizeof(conn_t));
+    CO_INIT(&c->co);
+    c->loop = loop;
+    c->client.conn = c;
+    c->client.fd = connfd;
+    c->server.conn = c;
+    c->server.fd = -1;
+    c->req_cap = REQ_INIT_SIZE;
+    c->req = Calloc(1, c->req_cap);
+    tw_timer_init(&c->timer, conn_timeout, c);
+    c->waiter.wake = conn_wake;
+    watch_fd(loop, &c->client);
+
+    // 요청이 이미 도착해 있을 수도 있으므로 바로 한 번 진행
+    if (conn_run(c) < 0)
+      conn_close(c);
+  }
+}
+
+/* 웹 서버로 보낼 요청 헤더를 만들고 주소 조회를 resolver thread 에 맡김 (conn_run 이 connect 전에 기다림) */
+static void prepare_upstream(conn_t *c)
+{
+  char uri[MAXLINE], http_header[MAXLINE];
+  char hostname[MAXLINE], path[MAXLINE] = "/";
+  int port;
+
+  strcpy(uri, c->uri); // parse_uri 가 고쳐 씀
+  parse_uri(uri, hostname, path, &port);
+  build_http_header_buf(http_header, hostname, path, strstr(c->req, "\r\n") + 2);
+  add_conditional_header(http_header, &c->fill); // 캐시의 만료된 응답을 재검증하는 요청이면 validator 를 붙임
+  c->http_header = strdup(http_header);
+  c->header_len = strlen(http_header);
+
+  upstream_timeouts(hostname, port, &c->timeouts);
+  c->resolving = 1; // resolver thread 에 넘기기 전이므로 lock 없이
+  c->resolve.complete = conn_resolved;
+  upstream_resolve_start(&c->resolve, hostname, port);
+}
+
+/* 요청 헤더를 다 읽은 뒤: 캐시 확인. hit 이면 보낼 수 있는 만큼 보내고 1 (나머지는 c->hit 에서 c->sent 부터),
+   같은 uri 를 받아 오는 중인 연결이 있으면 follower 로 붙고 2,
+   아니면 leader 로 웹 서버로 보낼 헤더를 만들고 주소 조회를 맡긴 뒤 0, 처리할 수 없는 요청이면 -1 */
+static int prepare_request(conn_t *c)
+{
+  char method[MAXLINE], version[MAXLINE], uri[MAXLINE];
+  int rc, role;
+
+  log_msg(0, "Request headers: \n%.*s", (int)(strstr(c->req, "\r\n") + 2 - c->req), c->req);
+  if (sscanf(c->req, "%s %s %s", method, uri, version) != 3)
+    return -1;
+
+  if (strcasecmp(method, "GET"))
+  {
+    log_msg(0, "Proxy does not implement the method\n");
+    return -1;
+  }
+  c->uri = strdup(uri);
+
+  /* 요청 uri 주소가 캐싱되어 있는 주소 인지. 없으면 같은 uri 를 받아 오는 중인 연결에 붙거나 직접 받아 옴 */
+  while ((rc = cache_send(c->loop->cache, c->uri, c->client.fd, &c->hit, &c->sent)) < 0 &&
+         (role = cache_fill_start(c->loop->cache, c->uri, &c->fill, &c->follow)) < 0)
+    ; // 그 사이에 캐싱이 끝남. 다시 조회
+  if (rc >= 0)
+    return 1;
+  if (role == 1)
+    return 2;
+  prepare_upstream(c);
+  return 0;
+}
+
+/* connect 완료 여부 확인. 진행 중인 socket 에 connect 를 다시 호출하면 EALREADY, 끝났으면 EISCONN.
+   1 연결됨, 0 진행 중, -1 실패 */
+static int connect_result(conn_t *c)
+{
+  struct addrinfo *p = c->cur_addr;
+
+  if (connect(c->server.fd, p->ai_addr, p->ai_addrlen) == 0 || errno == EISCONN)
+    return 1;
+  if (errno == EALREADY || errno == EINPROGRESS || errno == EINTR)
+    return 0;
+  return -1;
+}
+
+/* 웹 서버 실패 (연결 실패, 읽기 실패, timeout). 재검증하던 응답이 stale-if-error 기간이면 c->hit 에 참조를 잡고 1 */
+static int use_stale(conn_t *c)
+{
+  if ((c->hit = cache_fill_error(&c->fill)) == NULL)
+    return 0;
+  conn_arm(c, c->timeouts.idle_ms);
+  return 1;
+}
+
+/* 연결 하나의 처리 전체 (doit 의 coroutine 버전). CO_WAIT 이면 다음 이벤트 대기, CO_DONE 이면 연결 종료 */
+static int conn_run(conn_t *c)
+{
+  co_t *co = &c->co;
+  ssize_t n;
+  int rc;
+
+  CO_BEGIN(co);
+
+  /* 클라이언트 요청 헤더를 빈 줄까지 읽음 */
+  while (strstr(c->req, "\r\n\r\n") == NULL)
+  {
+    if (c->req_len == c->req_cap - 1)
+    {
+      if (c->req_cap >= MAXLINE) // 헤더가 너무 큼
+        CO_EXIT(co);
+      c->req_cap *= 2;
+      c->req = Realloc(c->req, c->req_cap);
+    }
+    CO_AWAIT_IO(co, n, read(c->client.fd, c->req + c->req_len, c->req_cap - 1 - c->req_len));
+    if (n <= 0) // 요청을 다 보내기 전에 클라이언트가 끊음
+      CO_EXIT(co);
+    c->req_len += n;
+    c->req[c->req_len] = '\0';
+  }
+
+  if ((rc = prepare_request(c)) < 0)
+    CO_EXIT(co);
+
+  /* 캐시 hit: 한 번에 다 못 보냈으면 참조를 잡은 응답의 나머지를 씀 */
+  if (rc == 1)
+  {
+    for (; c->hit != NULL && c->sent < CACHE_ENTRY_LEN(c->hit); c->sent += n)
+    {
+      CO_AWAIT_IO(co, n, cache_entry_send(c->hit, c->client.fd, c->sent, 0));
+      if (n < 0)
+        break;
+    }
+    CO_EXIT(co);
+  }
+
+  /* follower: leader 가 받는 대로 클라이언트에 씀. 새 데이터가 오면 leader 쪽에서 ready_conns 로 깨움 */
+  if (rc == 2)
+  {
+    while ((n = cache_follow_next(&c->follow, &c->buf, &c->waiter)) != 0)
+    {
+      if (n == CACHE_FOLLOW_WAIT)
+      {
+        CO_YIELD(co);
+        continue;
+      }
+      if (n < 0) // leader 실패, 또는 공유하면 안 되는 응답
+        break;
+      c->buf_len = n;
+      AWAIT_WRITE_ALL(co, n, c->client.fd, c->buf, c->buf_len, c->sent);
+      if (n < 0)
+        break;
+      cache_follow_advance(&c->follow, c->buf_len);
+    }
+    if (n != CACHE_FOLLOW_PASS)
+    {
+      if (n != 0 && c->follow.pos == 0) // 아무것도 못 받고 실패함
+      {
+        c->buf_len = strlen(gateway_timeout_response);
+        AWAIT_WRITE_ALL(co, n, c->client.fd, gateway_timeout_response, c->buf_len, c->sent);
+      }
+      CO_EXIT(co);
+    }
+    /* 공유하면 안 되는 응답 (private 등). 이 연결도 캐싱하지 않고 직접 웹 서버에서 받아 옴 */
+    cache_follow_release(&c->follow);
+    cache_fill_pass(&c->fill);
+    prepare_upstream(c);
+  }
+
+  /* 디스크 tier 로 내려간 응답이면 웹 서버 대신 디스크에서 읽음 (regular file 이라 기다리지 않음).
+     클라이언트가 끊어도 follower 가 있으면 끝까지 읽어서 메모리로 다시 올림 */
+  if (cache_fill_disk(&c->fill))
+  {
+    while ((n = cache_fill_disk_next(&c->fill, &c->buf)) > 0)
+    {
+      for (c->buf_len = n, c->sent = 0; !c->client_gone && c->sent < c->buf_len; c->sent += n)
+      {
+        conn_arm(c, c->timeouts.idle_ms);
+        CO_AWAIT_IO(co, n, write(c->client.fd, c->buf + c->sent, c->buf_len - c->sent));
+        if (n < 0)
+        {
+          if (!cache_fill_shared(&c->fill))
+            CO_EXIT(co);
+          c->client_gone = 1;
+          break;
+        }
+      }
+    }
+    if (n == 0) // 읽는 사이에 log 가 덮어썼으면 (n < 0) conn_close 가 abort 함
+      cache_fill_finish(&c->fill);
+    CO_EXIT(co);
+  }
+
+  /* 주소 조회가 끝나기를 기다린 뒤 (resolver thread 가 remote_ready 로 깨움) 웹 서버 주소를 차례로 connect.
+     조회와 주소 목록 전체가 connect timeout 하나를 나눠 씀 */
+  conn_arm(c, c->timeouts.connect_ms);
+  CO_AWAIT(co, atomic_load_explicit(&c->resolve.done, memory_order_acquire));
+  if (c->resolve.rc != 0)
+    log_msg(1, "getaddrinfo failed (%s): %s\n", c->uri, gai_strerror(c->resolve.rc));
+  for (c->cur_addr = c->resolve.addrs; c->cur_addr != NULL; c->cur_addr = c->cur_addr->ai_next)
+  {
+    if ((c->server.fd = upstream_connect_start(c->cur_addr)) < 0)
+      continue;
+    watch_fd(c->loop, &c->server);
+    CO_AWAIT(co, (rc = connect_result(c)) != 0);
+    if (rc > 0)
+      break;
+    close(c->server.fd); // 이 주소로는 실패, 다음 주소로 재시도
+    c->server.fd = -1;
+  }
+  if (c->server.fd < 0)
+  {
+    log_msg(0, "connection failed\n");
+    if (use_stale(c))
+      goto send_cached;
+    CO_EXIT(co);
+  }
+
+  /* 재구성한 요청 헤더를 웹 서버로 전송. 응답 첫 바이트가 올 때까지 firstbyte timeout */
+  conn_arm(c, c->timeouts.firstbyte_ms);
+  AWAIT_WRITE_ALL(co, n, c->server.fd, c->http_header, c->header_len, c->sent);
+  if (n < 0 && use_stale(c))
+    goto send_cached;
+  if (n < 0)
+    CO_EXIT(co);
+
+  /* 웹 서버 응답을 캐시 segment 에 바로 읽어서 그 자리에서 클라이언트에 씀.
+     클라이언트가 못 받으면 웹 서버에서도 더 읽지 않음 */
+  while (1)
+  {
+    c->buf = cache_fill_buf(&c->fill, &c->buf_len);
+    CO_AWAIT_IO(co, n, read(c->server.fd, c->buf, c->buf_len));
+    if (n < 0 && use_stale(c))
+      goto send_cached;
+    if (n < 0)
+      CO_EXIT(co);
+    if (n == 0) // 웹 서버 응답 끝
+      break;
+    c->buf_len = cache_fill_commit(&c->fill, n, &c->buf); // 재검증 중이면 304 인지 알 때까지 0
+    conn_arm(c, c->timeouts.idle_ms); // 어느 쪽으로든 데이터가 오가는 동안은 idle 이 아님
+
+    for (c->sent = 0; !c->client_gone && c->sent < c->buf_len; c->sent += n)
+    {
+      conn_arm(c, c->timeouts.idle_ms);
+      CO_AWAIT_IO(co, n, write(c->client.fd, c->buf + c->sent, c->buf_len - c->sent));
+      if (n < 0)
+      {
+        if (!cache_fill_shared(&c->fill))
+          CO_EXIT(co);
+        c->client_gone = 1; // follower 들을 위해 웹 서버 응답은 끝까지 받음
+        break;
+      }
+    }
+  }
+
+  /* MAX_OBJECT_SIZE 보다 작게 끝난 응답만 캐싱. 재검증한 응답이 304 였으면 캐시의 응답을 보냄 */
+  if ((c->hit = cache_fill_finish(&c->fill)) == NULL || c->client_gone)
+    CO_EXIT(co);
+send_cached: // 304, 또는 stale-if-error 로 대신 보내는 캐시의 응답
+  for (c->sent = 0; c->sent < CACHE_ENTRY_LEN(c->hit); c->sent += n)
+  {
+    conn_arm(c, c->timeouts.idle_ms);
+    CO_AWAIT_IO(co, n, cache_entry_send(c->hit, c->client.fd, c->sent, 0));
+    if (n < 0)
+      break;
+  }
+  CO_EXIT(co);
+
+  /* 웹 서버 timeout. 재검증하던 응답이 stale-if-error 기간이면 그것을 보내고,
+     아직 응답을 하나도 못 보냈으면 504 를 보내고, 도중이면 그냥 끊음 */
+  CO_CANCELLED(co);
+  log_msg(0, "upstream timeout\n");
+  if (c->hit != NULL) // 캐시의 응답을 보내던 중
+    CO_EXIT(co);
+  if (c->server.fd >= 0)
+  {
+    close(c->server.fd);
+    c->server.fd = -1;
+  }
+  if (use_stale(c))
+    goto send_cached;
+  if (c->fill.len > 0)
+    CO_EXIT(co);
+  c->buf_len = strlen(gateway_timeout_response);
+  AWAIT_WRITE_ALL(co, n, c->client.fd, gateway_timeout_response, c->buf_len, c->sent);
+
+  CO_END(co);
+}
+
+/* event loop. listenfd 와 모든 연결을 이 thread 하나가 처리 */
+void event_loop(int listenfd, Cache *cache)
+{
+  struct epoll_event events[MAX_EVENTS];
+  ev_handle_t listen_handle = {NULL, listenfd}, wake_handle;
+  loop_t loop = {-1, listenfd, cache, NULL};
+  int flags;
+
+  if ((loop.epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    unix_error("epoll_create1 error");
+  tw_init(&loop.timers, TIMER_TICK_MS);
+  loop.tid = pthread_self();
+  if ((loop.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+    unix_error("eventfd error");
+  pthread_mutex_init(&loop.remote_lock, NULL);
+  wake_handle.conn = NULL;
+  wake_handle.fd = loop.wakefd;
+  watch_fd(&loop, &wake_handle);
+
+  flags = fcntl(listenfd, F_GETFL, 0);
+  fcntl(listenfd, F_SETFL, flags | O_NONBLOCK);
+  watch_fd(&loop, &listen_handle);
+
+  while (1)
+  {
+    int n = epoll_wait(loop.epfd, events, MAX_EVENTS, tw_next_timeout(&loop.timers));
+    if (n < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      unix_error("epoll_wait error");
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+      ev_handle_t *h = events[i].data.ptr;
+      if (h->conn == NULL && h->fd == loop.wakefd)
+      {
+        take_remote_ready(&loop);
+        continue;
+      }
+      if (h->conn == NULL)
+      {
+        accept_conns(&loop);
+        continue;
+      }
+      if (h->conn->closed)
+        continue;
+      if (conn_run(h->conn) < 0)
+        conn_close(h->conn);
+    }
+    tw_advance(&loop.timers, tw_now_ms());
+    run_ready_conns(&loop);
+    free_closed_conns(&loop);
+  }
+}
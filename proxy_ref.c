@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "csapp.h"
+#include "hindex.h"
 /* Recommended max cache and object sizes */
 #define MAX_CACHE_SIZE 1049000
 #define MAX_OBJECT_SIZE 102400
@@ -35,6 +36,7 @@ void readerAfter(int i);
 typedef struct {
     char cache_obj[MAX_OBJECT_SIZE];
     char cache_url[MAXLINE];
+    uint64_t hash;          /*hash of cache_url, checked before strcmp*/
     int LRU;
     int isEmpty;
 
@@ -47,6 +49,9 @@ typedef struct {
 typedef struct {
     cache_block cacheobjs[CACHE_OBJS_COUNT];  /*ten cache blocks*/
     int cache_num;
+
+    hindex_t index;         /*url hash -> cache block*/
+    sem_t indexmutex;       /*protects index and cache_url/hash of every block*/
 }Cache;
 
 Cache cache;
@@ -120,7 +125,6 @@ void doit(int connfd)
     /*the uri is cached ? */
     int cache_index;
     if((cache_index=cache_find(url_store))!=-1){/*in cache then return the cache content*/
-         readerPre(cache_index);
          Rio_writen(connfd,cache.cacheobjs[cache_index].cache_obj,strlen(cache.cacheobjs[cache_index].cache_obj));
          readerAfter(cache_index);
          return;
@@ -244,8 +248,18 @@ void parse_uri(char *uri,char *hostname,char *path,int *port)
  * Cache Function
  **************************************/
 
+static uint64_t cache_hash_of(int32_t i,void *arg){
+    return cache.cacheobjs[i].hash;
+}
+
+static int cache_eq(int32_t i,const void *url,void *arg){
+    return cache.cacheobjs[i].hash==hindex_hash(url) && strcmp(url,cache.cacheobjs[i].cache_url)==0;
+}
+
 void cache_init(){
     cache.cache_num = 0;
+    hindex_init(&cache.index,CACHE_OBJS_COUNT,cache_hash_of,NULL);
+    Sem_init(&cache.indexmutex,0,1);
     int i;
     for(i=0;i<CACHE_OBJS_COUNT;i++){
         cache.cacheobjs[i].LRU = 0;
@@ -279,15 +293,20 @@ void writeAfter(int i){
     V(&cache.cacheobjs[i].wmutex);
 }
 
-/*find url is in the cache or not */
+/*find url is in the cache or not.
+  on hit the reader lock of the block is held, caller must readerAfter*/
 int cache_find(char *url){
     int i;
-    for(i=0;i<CACHE_OBJS_COUNT;i++){
-        readerPre(i);
-        if((cache.cacheobjs[i].isEmpty==0) && (strcmp(url,cache.cacheobjs[i].cache_url)==0)) break;
+    P(&cache.indexmutex);
+    i = hindex_find(&cache.index,hindex_hash(url),cache_eq,url);
+    V(&cache.indexmutex);
+    if(i<0) return -1; /*can not find url in the cache*/
+
+    readerPre(i);
+    if(strcmp(url,cache.cacheobjs[i].cache_url)!=0){ /*replaced after the index lookup*/
         readerAfter(i);
+        return -1;
     }
-    if(i>=CACHE_OBJS_COUNT) return -1; /*can not find url in the cache*/
     return i;
 }
 
@@ -341,8 +360,15 @@ void cache_uri(char *uri,char *buf){
 
     writePre(i);/*writer P*/
 
-    strcpy(cache.cacheobjs[i].cache_obj,buf);
+    P(&cache.indexmutex);
+    if(cache.cacheobjs[i].isEmpty==0)
+        hindex_erase(&cache.index,cache.cacheobjs[i].hash,i);
     strcpy(cache.cacheobjs[i].cache_url,uri);
+    cache.cacheobjs[i].hash = hindex_hash(uri);
+    hindex_insert(&cache.index,cache.cacheobjs[i].hash,i);
+    V(&cache.indexmutex);
+
+    strcpy(cache.cacheobjs[i].cache_obj,buf);
     cache.cacheobjs[i].isEmpty = 0;
     cache.cacheobjs[i].LRU = LRU_MAGIC_NUMBER;
     cache_LRU(i);
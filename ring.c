@@ -0,0 +1,180 @@
+/*
+    ring.c - lock-free bounded MPMC ring buffer + futex parking
+*/
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "csapp.h"
+#include "ring.h"
+
+/* slot 하나: 앞에 sequence 번호, 바로 뒤에 원소 */
+typedef struct
+{
+  atomic_size_t seq;
+  char data[];
+} ring_slot_t;
+
+static inline ring_slot_t *slot_at(ring_t *r, size_t pos)
+{
+  return (ring_slot_t *)(r->slots + (pos & r->mask) * r->stride);
+}
+
+/* capacity 는 2의 거듭제곱으로 올림 */
+void ring_init(ring_t *r, size_t capacity, size_t elem_size)
+{
+  size_t cap = 2;
+
+  while (cap < capacity)
+    cap <<= 1;
+  r->mask = cap - 1;
+  r->elem_size = elem_size;
+  r->stride = (sizeof(ring_slot_t) + elem_size + RING_CACHELINE - 1) & ~(size_t)(RING_CACHELINE - 1);
+  if (posix_memalign((void **)&r->slots, RING_CACHELINE, cap * r->stride) != 0)
+    unix_error("ring_init error");
+
+  /* slot i 의 sequence 가 i 이면 "i 번째 push 를 기다리는 빈 칸" */
+  for (size_t i = 0; i < cap; i++)
+    atomic_init(&slot_at(r, i)->seq, i);
+  atomic_init(&r->enqueue_pos, 0);
+  atomic_init(&r->dequeue_pos, 0);
+  atomic_init(&r->wake_seq, 0);
+  atomic_init(&r->nwaiters, 0);
+}
+
+int ring_push(ring_t *r, const void *elem)
+{
+  size_t pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+  ring_slot_t *slot;
+
+  while (1)
+  {
+    slot = slot_at(r, pos);
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    long dif = (long)seq - (long)pos;
+
+    if (dif == 0) // 빈 칸. 이 위치를 차지해 봄
+    {
+      if (atomic_compare_exchange_weak_explicit(&r->enqueue_pos, &pos, pos + 1,
+                                                memory_order_relaxed, memory_order_relaxed))
+        break;
+    }
+    else if (dif < 0) // 한 바퀴 전 원소를 아직 아무도 안 꺼내감 = 가득 참
+      return -1;
+    else // 다른 producer 가 먼저 차지함
+      pos = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+  }
+
+  memcpy(slot->data, elem, r->elem_size);
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release); // "채워짐" 표시
+  ring_wake(r);
+  return 0;
+}
+
+int ring_pop(ring_t *r, void *elem)
+{
+  return ring_pop_batch(r, elem, 1) == 1 ? 0 : -1;
+}
+
+/* dequeue_pos 부터 연속으로 채워진 slot 을 최대 max 개 세고, CAS 한 번으로 한꺼번에 차지 */
+size_t ring_pop_batch(ring_t *r, void *elems, size_t max)
+{
+  size_t pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+  size_t n;
+
+  while (1)
+  {
+    for (n = 0; n < max; n++)
+    {
+      size_t seq = atomic_load_explicit(&slot_at(r, pos + n)->seq, memory_order_acquire);
+      if (seq != pos + n + 1)
+        break;
+    }
+
+    if (n == 0)
+    {
+      size_t seq = atomic_load_explicit(&slot_at(r, pos)->seq, memory_order_acquire);
+      if ((long)seq - (long)(pos + 1) < 0) // 아직 안 채워짐 = 비었음
+        return 0;
+      pos = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed); // 다른 consumer 가 먼저 가져감
+      continue;
+    }
+    if (atomic_compare_exchange_weak_explicit(&r->dequeue_pos, &pos, pos + n,
+                                              memory_order_relaxed, memory_order_relaxed))
+      break;
+  }
+
+  /* 차지한 slot 들은 sequence 를 돌려놓기 전까지 producer 가 덮어쓰지 않음 */
+  for (size_t i = 0; i < n; i++)
+  {
+    ring_slot_t *slot = slot_at(r, pos + i);
+    memcpy((char *)elems + i * r->elem_size, slot->data, r->elem_size);
+    atomic_store_explicit(&slot->seq, pos + i + r->mask + 1, memory_order_release); // 다음 바퀴의 빈 칸
+  }
+  return n;
+}
+
+size_t ring_count(ring_t *r)
+{
+  size_t enq = atomic_load_explicit(&r->enqueue_pos, memory_order_relaxed);
+  size_t deq = atomic_load_explicit(&r->dequeue_pos, memory_order_relaxed);
+  return enq > deq ? enq - deq : 0;
+}
+
+/* 잠들 준비. 여기서 읽은 key 이후에 누가 깨우면 ring_wait 는 바로 돌아옴 */
+unsigned ring_prepare_wait(ring_t *r)
+{
+  atomic_fetch_add(&r->nwaiters, 1);
+  return atomic_load(&r->wake_seq);
+}
+
+void ring_cancel_wait(ring_t *r)
+{
+  atomic_fetch_sub(&r->nwaiters, 1);
+}
+
+void ring_wait(ring_t *r, unsigned key)
+{
+  ring_timedwait(r, key, -1);
+}
+
+/* ms 가 음수면 무한정 기다림. 시간이 다 돼서 돌아왔으면 -1 */
+int ring_timedwait(ring_t *r, unsigned key, long ms)
+{
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000};
+  long rc = syscall(SYS_futex, &r->wake_seq, FUTEX_WAIT_PRIVATE, key, ms < 0 ? NULL : &ts, NULL, 0);
+  int timedout = rc < 0 && errno == ETIMEDOUT;
+
+  atomic_fetch_sub(&r->nwaiters, 1);
+  return timedout ? -1 : 0;
+}
+
+/* push 한 원소가 nwaiters 읽기보다 먼저 보이도록 fence. 잠든 consumer 가 없으면 시스템 콜 없음 */
+void ring_wake(ring_t *r)
+{
+  ring_wake_n(r, 1);
+}
+
+void ring_wake_n(ring_t *r, int n)
+{
+  int nwaiters;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  if ((nwaiters = atomic_load_explicit(&r->nwaiters, memory_order_relaxed)) > 0 && n > 0)
+  {
+    atomic_fetch_add(&r->wake_seq, 1);
+    syscall(SYS_futex, &r->wake_seq, FUTEX_WAKE_PRIVATE, n < nwaiters ? n : nwaiters, NULL, NULL, 0);
+  }
+}
+
+void ring_pop_wait(ring_t *r, void *elem)
+{
+  while (ring_pop(r, elem) < 0)
+  {
+    unsigned key = ring_prepare_wait(r);
+    if (ring_pop(r, elem) == 0)
+    {
+      ring_cancel_wait(r);
+      return;
+    }
+    ring_wait(r, key);
+  }
+}
@@ -0,0 +1,50 @@
+/*
+    ring.h - lock-free bounded MPMC ring buffer
+
+    slot 마다 sequence 번호를 두는 방식 (Dmitry Vyukov 의 bounded MPMC queue).
+    producer 와 consumer 는 각자 위치(enqueue_pos / dequeue_pos)를 CAS 로 하나씩 차지하고,
+    slot 의 sequence 로 "비었음 / 채워짐" 을 판단하므로 mutex 가 필요 없음.
+    원소는 포인터가 아니라 elem_size 바이트 값 그대로 slot 에 복사됨 (malloc 없음).
+
+    consumer 는 ring 이 비었을 때만 futex 에서 잠들고,
+    producer 는 잠든 consumer 가 있을 때만 futex wake 시스템 콜을 부름.
+*/
+#ifndef __RING_H__
+#define __RING_H__
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+#define RING_CACHELINE 64
+
+typedef struct
+{
+  /* producer 와 consumer 가 같은 cache line 을 두고 경쟁하지 않도록 떨어뜨려 둠 */
+  _Alignas(RING_CACHELINE) atomic_size_t enqueue_pos;
+  _Alignas(RING_CACHELINE) atomic_size_t dequeue_pos;
+  _Alignas(RING_CACHELINE) atomic_uint wake_seq; // futex word. 깨울 때마다 증가
+  atomic_int nwaiters;                           // futex 에서 잠들었거나 잠들려는 consumer 수
+
+  size_t mask;   // 용량 - 1 (용량은 2의 거듭제곱)
+  size_t elem_size;
+  size_t stride; // slot 하나의 크기 (sequence + 원소, cache line 단위로 맞춤)
+  char *slots;
+} ring_t;
+
+void ring_init(ring_t *r, size_t capacity, size_t elem_size);
+int ring_push(ring_t *r, const void *elem);                // 가득 찼으면 -1
+int ring_pop(ring_t *r, void *elem);                       // 비었으면 -1
+size_t ring_pop_batch(ring_t *r, void *elems, size_t max); // CAS 한 번으로 최대 max 개, 꺼낸 개수 반환
+size_t ring_count(ring_t *r);                              // 대략적인 원소 수
+void ring_pop_wait(ring_t *r, void *elem);                 // 원소가 생길 때까지 futex 에서 잠듦
+
+/* consumer 가 ring 말고 다른 것도 확인한 뒤 잠들어야 할 때 쓰는 저수준 함수
+   key = ring_prepare_wait(r); 다시 확인; 일이 있으면 ring_cancel_wait(r), 없으면 ring_wait(r, key) */
+unsigned ring_prepare_wait(ring_t *r);
+void ring_cancel_wait(ring_t *r);
+void ring_wait(ring_t *r, unsigned key);
+int ring_timedwait(ring_t *r, unsigned key, long ms); // 최대 ms 밀리초. 시간이 다 됐으면 -1
+void ring_wake(ring_t *r); // 잠든 consumer 가 있으면 하나 깨움
+void ring_wake_n(ring_t *r, int n); // 잠든 consumer 를 최대 n 개 깨움
+
+#endif /* __RING_H__ */
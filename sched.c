@@ -0,0 +1,502 @@
+/*
+    sched.c - work-stealing scheduler
+
+    Chase-Lev deque 는 "Correct and Efficient Work-Stealing for Weak Memory Models"
+    (Lê et al., PPoPP 2013) 의 C11 atomics 버전을 그대로 따름.
+
+    worker 수는 min ~ max 사이에서 늘었다 줄었다 함.
+    - 늘리기 : monitor thread 가 GROW_TICK_MS 마다 확인해서
+               (1) 밀린 작업이 (ring 이나 worker deque 에) 있는데 모든 worker 가 handler 안에 있거나 (느린 웹 서버에 막혀 있음)
+               (2) 작업이 ring 에서 기다린 시간의 평균이 QWAIT_TARGET_US 를 넘으면 worker 를 추가
+    - 줄이기 : IDLE_TIMEOUT_MS 동안 일이 없었던 worker 는 min 보다 많을 때 스스로 종료
+
+    과부하 제어는 CoDel ("Controlling Queue Delay", Nichols & Jacobson, 2012) 방식.
+    worker 가 작업을 꺼낼 때 제출 후 기다린 시간(sojourn)을 보고, 그 시간이 interval 내내
+    target 을 넘어 있으면 그 작업은 handler 대신 shed 함수로 넘김 (버림). 버리는 간격은
+    interval / sqrt(버린 횟수) 로 점점 짧아지고, 대기 시간이 target 아래로 내려오면 멈춤.
+*/
+#include <time.h>
+#include "csapp.h"
+#include "sched.h"
+
+#define DEQUE_INIT_SIZE 64
+#define STEAL_BATCH 8       // ring 에서 한 번에 가져오는 최대 작업 수
+#define SCHED_RING_SIZE 1024 // 넘겨받기를 기다릴 수 있는 최대 작업 수
+
+#define GROW_TICK_MS 5        // monitor thread 가 pool 크기를 확인하는 주기
+#define QWAIT_TARGET_US 2000  // 작업이 worker 를 기다린 시간(평균)이 이보다 길면 worker 추가
+#define IDLE_TIMEOUT_MS 10000 // 이만큼 놀던 worker 는 min 을 넘는 만큼 종료
+
+/* ring/deque 에 들어가는 원소: 제출 시각 + 사용자 작업 */
+typedef struct
+{
+  long long enq_ns;
+  _Alignas(8) char job[];
+} slot_job_t;
+
+/* CoDel 상태. 대기 시간이 target 아래일 때는 lock 없이 first_above 만 지움 */
+typedef struct
+{
+  pthread_mutex_t lock;
+  long long target_ns, interval_ns;
+  atomic_llong first_above; // 대기 시간이 target 을 넘은 채로 이 시각이 지나면 버리기 시작 (0 이면 아래에 있음)
+  atomic_int dropping;      // 버리는 중인지
+  long long drop_next;      // 다음으로 버릴 시각
+  int count;                // 이번에 버리기 시작한 뒤 버린 수
+} codel_t;
+
+/* worker 하나의 상태. max 개를 미리 만들어 두고 살아있는 worker 만 live=1 */
+typedef struct
+{
+  sched_t *sched;
+  int id;
+  atomic_int live;
+  unsigned seed; // 훔칠 대상 worker 를 고르는 난수 상태
+  deque_t dq;    // ring 에서 batch 로 가져온 나머지 작업들 (heap 복사본). 다른 worker 가 훔쳐갈 수 있음
+  char *batch;   // ring_pop_batch 로 꺼낸 작업들을 받는 버퍼
+} worker_t;
+
+struct sched
+{
+  ring_t ring; // 제출된 작업. 비었을 때 worker 가 이 ring 의 futex 에서 잠듦
+  int min_workers, max_workers;
+  size_t job_size, elem_size; // 사용자 작업 크기, ring 원소 크기 (slot_job_t 포함)
+  worker_t *workers;          // max_workers 개. 종료된 자리는 다음에 늘릴 때 재사용
+  sched_handler_t handler;
+  sched_handler_t shed; // CoDel 이 버리기로 한 작업을 받는 함수 (NULL 이면 과부하 제어 안 함)
+  codel_t codel;
+
+  atomic_int nlive;      // 살아있는 worker 수
+  atomic_int nbusy;      // handler 를 실행 중인 worker 수
+  atomic_llong qwait_ns; // 작업이 제출된 뒤 실행되기까지 걸린 시간의 이동 평균
+};
+
+static long long now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static deque_array_t *deque_array_new(long size)
+{
+  deque_array_t *a = Malloc(sizeof(deque_array_t) + size * sizeof(void *));
+  atomic_init(&a->size, size);
+  return a;
+}
+
+void deque_init(deque_t *dq)
+{
+  atomic_init(&dq->top, 0);
+  atomic_init(&dq->bottom, 0);
+  atomic_init(&dq->array, deque_array_new(DEQUE_INIT_SIZE));
+}
+
+/* 배열이 가득 차면 두 배로 늘림. 예전 배열은 steal 중인 thread 가 읽고 있을 수 있어서 해제하지 않음 */
+static deque_array_t *deque_grow(deque_t *dq, deque_array_t *a, long top, long bottom)
+{
+  long size = atomic_load_explicit(&a->size, memory_order_relaxed);
+  deque_array_t *na = deque_array_new(size * 2);
+
+  for (long i = top; i < bottom; i++)
+    atomic_store_explicit(&na->slots[i & (size * 2 - 1)],
+                          atomic_load_explicit(&a->slots[i & (size - 1)], memory_order_relaxed),
+                          memory_order_relaxed);
+  atomic_store_explicit(&dq->array, na, memory_order_release);
+  return na;
+}
+
+/* owner 전용. bottom 에 작업 추가 */
+void deque_push(deque_t *dq, void *job)
+{
+  long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed);
+  long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+  deque_array_t *a = atomic_load_explicit(&dq->array, memory_order_relaxed);
+  long size = atomic_load_explicit(&a->size, memory_order_relaxed);
+
+  if (b - t > size - 1)
+  {
+    a = deque_grow(dq, a, t, b);
+    size *= 2;
+  }
+  atomic_store_explicit(&a->slots[b & (size - 1)], job, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+}
+
+/* owner 전용. bottom 에서 작업 하나 꺼냄 (마지막 하나일 때만 steal 과 CAS 경쟁). 없으면 NULL */
+void *deque_take(deque_t *dq)
+{
+  long b = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - 1;
+  deque_array_t *a = atomic_load_explicit(&dq->array, memory_order_relaxed);
+  atomic_store_explicit(&dq->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&dq->top, memory_order_relaxed);
+  void *job = NULL;
+
+  if (t <= b)
+  {
+    long size = atomic_load_explicit(&a->size, memory_order_relaxed);
+    job = atomic_load_explicit(&a->slots[b & (size - 1)], memory_order_relaxed);
+    if (t == b)
+    {
+      if (!atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                   memory_order_seq_cst, memory_order_relaxed))
+        job = NULL; // 다른 thread 가 먼저 훔쳐감
+      atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+    }
+  }
+  else
+    atomic_store_explicit(&dq->bottom, b + 1, memory_order_relaxed);
+  return job;
+}
+
+/* 아무 thread. top 에서 작업 하나 훔침. 비었거나 다른 thread 와 경쟁에서 지면 NULL */
+void *deque_steal(deque_t *dq)
+{
+  long t = atomic_load_explicit(&dq->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&dq->bottom, memory_order_acquire);
+
+  if (t < b)
+  {
+    deque_array_t *a = atomic_load_explicit(&dq->array, memory_order_acquire);
+    long size = atomic_load_explicit(&a->size, memory_order_relaxed);
+    void *job = atomic_load_explicit(&a->slots[t & (size - 1)], memory_order_relaxed);
+    if (atomic_compare_exchange_strong_explicit(&dq->top, &t, t + 1,
+                                                memory_order_seq_cst, memory_order_relaxed))
+      return job;
+  }
+  return NULL;
+}
+
+/* ring 에 쌓인 작업을 최대 STEAL_BATCH 개 (남은 양의 절반 정도) 꺼내서 첫 번째는 local 로, 나머지는 자기 deque 로 */
+static int pop_batch(worker_t *w, void *local)
+{
+  sched_t *s = w->sched;
+  size_t want = ring_count(&s->ring) / 2 + 1;
+  size_t n;
+
+  if (want > STEAL_BATCH)
+    want = STEAL_BATCH;
+  if ((n = ring_pop_batch(&s->ring, w->batch, want)) == 0)
+    return 0;
+
+  memcpy(local, w->batch, s->elem_size);
+  for (size_t i = 1; i < n; i++)
+  {
+    void *copy = Malloc(s->elem_size);
+    memcpy(copy, w->batch + i * s->elem_size, s->elem_size);
+    deque_push(&w->dq, copy);
+  }
+  /* deque 로 옮긴 작업마다 잠든 worker 를 하나씩 깨워서 훔쳐가게 함.
+     하나만 깨우면 그 worker 와 나 둘 다 느린 웹 서버에 막혔을 때 나머지가 deque 에서 기다림 */
+  if (n > 1)
+    ring_wake_n(&s->ring, n - 1);
+  return 1;
+}
+
+/* 다음 작업 찾기: 자기 deque -> ring (batch) -> 다른 worker.
+   deque 에서 나온 작업은 heap 복사본, ring 에서 바로 꺼낸 작업은 local 에 담아서 반환 */
+static slot_job_t *find_job(worker_t *w, void *local)
+{
+  sched_t *s = w->sched;
+  void *job;
+
+  if ((job = deque_take(&w->dq)) != NULL)
+    return job;
+  if (pop_batch(w, local))
+    return local;
+
+  /* 임의의 자리부터 한 바퀴 돌면서 훔쳐봄. 종료된 worker 의 deque 는 비어 있으므로 그냥 지나감 */
+  int start = rand_r(&w->seed) % s->max_workers;
+  for (int i = 0; i < s->max_workers; i++)
+  {
+    worker_t *victim = &s->workers[(start + i) % s->max_workers];
+    if (victim != w && (job = deque_steal(&victim->dq)) != NULL)
+      return job;
+  }
+  return NULL;
+}
+
+/* 기다리는 작업 수: ring 에 남은 것 + pop_batch 로 worker deque 에 옮겨 둔 것 (막힌 worker 의 deque 에서 기다릴 수 있음).
+   stop 이 0 이 아니면 그만큼 세면 멈춤 */
+static size_t queued_jobs(sched_t *s, size_t stop)
+{
+  size_t n = ring_count(&s->ring);
+
+  for (int i = 0; i < s->max_workers && (stop == 0 || n < stop); i++)
+  {
+    deque_t *dq = &s->workers[i].dq;
+    long d = atomic_load_explicit(&dq->bottom, memory_order_relaxed) - atomic_load_explicit(&dq->top, memory_order_relaxed);
+    if (d > 0)
+      n += d;
+  }
+  return n;
+}
+
+static long long isqrt(long long n)
+{
+  long long x = n, y = (x + 1) / 2;
+
+  while (y < x)
+  {
+    x = y;
+    y = (x + n / x) / 2;
+  }
+  return x;
+}
+
+/* CoDel control law: 버린 횟수가 늘수록 다음 버릴 때까지의 간격을 줄임 */
+static long long codel_next(codel_t *cd, long long t)
+{
+  return t + cd->interval_ns / isqrt(cd->count);
+}
+
+/* 방금 꺼낸 작업을 버려야 하는지. sojourn 은 그 작업이 기다린 시간 */
+static int codel_should_drop(sched_t *s, long long sojourn, long long now)
+{
+  codel_t *cd = &s->codel;
+  int drop = 0, ok_to_drop;
+
+  /* 대기 시간이 target 아래거나 방금 꺼낸 게 마지막 작업이면 (줄이 없음) 정상 */
+  if (sojourn < cd->target_ns || queued_jobs(s, 1) == 0)
+  {
+    if (atomic_load_explicit(&cd->first_above, memory_order_relaxed) != 0)
+      atomic_store_explicit(&cd->first_above, 0, memory_order_relaxed);
+    if (atomic_load_explicit(&cd->dropping, memory_order_relaxed))
+      atomic_store_explicit(&cd->dropping, 0, memory_order_relaxed);
+    return 0;
+  }
+
+  pthread_mutex_lock(&cd->lock);
+  long long first_above = atomic_load_explicit(&cd->first_above, memory_order_relaxed);
+  if (first_above == 0)
+  {
+    atomic_store_explicit(&cd->first_above, now + cd->interval_ns, memory_order_relaxed);
+    ok_to_drop = 0;
+  }
+  else
+    ok_to_drop = now >= first_above;
+
+  if (atomic_load_explicit(&cd->dropping, memory_order_relaxed))
+  {
+    if (!ok_to_drop)
+      atomic_store_explicit(&cd->dropping, 0, memory_order_relaxed);
+    else if (now >= cd->drop_next)
+    {
+      drop = 1;
+      cd->count++;
+      cd->drop_next = codel_next(cd, cd->drop_next);
+    }
+  }
+  else if (ok_to_drop)
+  {
+    /* 직전에 버리던 상태에서 얼마 안 지났으면 이전 버리기 속도 근처에서 다시 시작 */
+    drop = 1;
+    atomic_store_explicit(&cd->dropping, 1, memory_order_relaxed);
+    cd->count = (cd->count > 2 && now - cd->drop_next < 8 * cd->interval_ns) ? cd->count - 2 : 1;
+    cd->drop_next = codel_next(cd, now);
+  }
+  pthread_mutex_unlock(&cd->lock);
+  return drop;
+}
+
+static void run_job(worker_t *w, slot_job_t *job, void *local)
+{
+  sched_t *s = w->sched;
+  long long now = now_ns();
+  long long waited = now - job->enq_ns;
+  long long avg = atomic_load_explicit(&s->qwait_ns, memory_order_relaxed);
+
+  /* 이동 평균 (1/8 가중). 여러 worker 가 동시에 갱신하다 하나가 묻혀도 상관 없음 */
+  atomic_store_explicit(&s->qwait_ns, avg + (waited - avg) / 8, memory_order_relaxed);
+
+  atomic_fetch_add_explicit(&s->nbusy, 1, memory_order_relaxed);
+  if (s->shed != NULL && codel_should_drop(s, waited, now))
+    s->shed(job->job);
+  else
+    s->handler(job->job);
+  atomic_fetch_sub_explicit(&s->nbusy, 1, memory_order_relaxed);
+  if ((void *)job != local)
+    free(job);
+}
+
+/* 살아있는 worker 가 min 보다 많을 때만 하나 줄이고 1 을 반환 */
+static int try_retire(sched_t *s)
+{
+  int n = atomic_load(&s->nlive);
+
+  while (n > s->min_workers)
+    if (atomic_compare_exchange_weak(&s->nlive, &n, n - 1))
+      return 1;
+  return 0;
+}
+
+static void *worker_main(void *arg)
+{
+  worker_t *w = arg;
+  sched_t *s = w->sched;
+  char *local = Malloc(s->elem_size);
+  slot_job_t *job;
+  long long idle_since = now_ns();
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    if ((job = find_job(w, local)) != NULL)
+    {
+      run_job(w, job, local);
+      idle_since = now_ns();
+      continue;
+    }
+
+    /* 잠들기 전에 waiter 로 등록하고 한 번 더 확인. 제출하는 쪽은 push 후 nwaiters 를 보므로
+       둘 중 하나는 반드시 상대를 보게 됨 (깨우는 신호를 놓치지 않음) */
+    unsigned key = ring_prepare_wait(&s->ring);
+    if ((job = find_job(w, local)) != NULL)
+    {
+      ring_cancel_wait(&s->ring);
+      run_job(w, job, local);
+      idle_since = now_ns();
+      continue;
+    }
+
+    long idle_ms = (now_ns() - idle_since) / 1000000;
+    if (idle_ms >= IDLE_TIMEOUT_MS)
+    {
+      ring_cancel_wait(&s->ring);
+      if (try_retire(s))
+        break;
+      idle_since = now_ns(); // min 개는 남아 있어야 하므로 다시 기다림
+      continue;
+    }
+    ring_timedwait(&s->ring, key, IDLE_TIMEOUT_MS - idle_ms); // 괜히 깨어나도 다시 찾아보고 잠들 뿐이라 문제 없음
+  }
+
+  /* 자기 deque 는 방금 비어 있는 걸 확인했음. 자리를 비워서 다음에 늘릴 때 재사용하게 함 */
+  free(local);
+  atomic_store_explicit(&w->live, 0, memory_order_release);
+  return NULL;
+}
+
+/* 비어 있는 자리에 worker 하나 추가. monitor thread 와 sched_create 에서만 부름 */
+static void spawn_worker(sched_t *s)
+{
+  pthread_t tid;
+
+  for (int i = 0; i < s->max_workers; i++)
+  {
+    worker_t *w = &s->workers[i];
+    if (atomic_load_explicit(&w->live, memory_order_acquire))
+      continue;
+    atomic_store(&w->live, 1);
+    atomic_fetch_add(&s->nlive, 1);
+    Pthread_create(&tid, NULL, worker_main, w);
+    return;
+  }
+}
+
+/* 주기적으로 pool 이 밀리고 있는지 보고 worker 를 늘림 */
+static void *monitor_main(void *arg)
+{
+  sched_t *s = arg;
+
+  Pthread_detach(pthread_self());
+  while (1)
+  {
+    usleep(GROW_TICK_MS * 1000);
+
+    int nlive = atomic_load(&s->nlive);
+    int nbusy = atomic_load_explicit(&s->nbusy, memory_order_relaxed);
+    size_t backlog = queued_jobs(s, 0);
+    long long qwait = atomic_load_explicit(&s->qwait_ns, memory_order_relaxed);
+
+    if (nlive >= s->max_workers || backlog == 0)
+      continue;
+
+    /* 모두 막혀 있으면 밀린 만큼 한꺼번에, 대기 시간만 길면 하나씩 늘림 */
+    int grow = 0;
+    if (nbusy >= nlive)
+      grow = backlog < (size_t)(s->max_workers - nlive) ? (int)backlog : s->max_workers - nlive;
+    else if (qwait > QWAIT_TARGET_US * 1000LL)
+      grow = 1;
+    while (grow-- > 0)
+      spawn_worker(s);
+  }
+  return NULL;
+}
+
+/* worker thread min_workers 개를 만들어 바로 작업을 기다리게 하고, 필요하면 max_workers 까지 늘림 */
+sched_t *sched_create(int min_workers, int max_workers, size_t job_size, sched_handler_t handler)
+{
+  sched_t *s;
+  pthread_t tid;
+
+  if (min_workers < 1)
+    min_workers = 1;
+  if (max_workers < min_workers)
+    max_workers = min_workers;
+
+  // ring 의 위치 변수들이 cache line 단위로 정렬되어 있으므로 malloc 대신 정렬된 할당
+  if (posix_memalign((void **)&s, RING_CACHELINE, sizeof(sched_t)) != 0)
+    unix_error("sched_create error");
+  memset(s, 0, sizeof(sched_t));
+  s->min_workers = min_workers;
+  s->max_workers = max_workers;
+  s->job_size = job_size;
+  s->elem_size = (sizeof(slot_job_t) + job_size + 7) & ~(size_t)7;
+  s->handler = handler;
+  ring_init(&s->ring, SCHED_RING_SIZE, s->elem_size);
+  atomic_init(&s->nlive, 0);
+  atomic_init(&s->nbusy, 0);
+  atomic_init(&s->qwait_ns, 0);
+  s->workers = Calloc(max_workers, sizeof(worker_t));
+
+  for (int i = 0; i < max_workers; i++)
+  {
+    worker_t *w = &s->workers[i];
+    w->sched = s;
+    w->id = i;
+    w->seed = i + 1;
+    atomic_init(&w->live, 0);
+    w->batch = Malloc(STEAL_BATCH * s->elem_size);
+    deque_init(&w->dq);
+  }
+  for (int i = 0; i < min_workers; i++)
+    spawn_worker(s);
+  if (max_workers > min_workers)
+    Pthread_create(&tid, NULL, monitor_main, s);
+  return s;
+}
+
+/* 작업 제출. 여러 thread 에서 동시에 불러도 됨. 잠든 worker 가 있을 때만 ring_push 가 깨움 */
+int sched_submit(sched_t *s, const void *job)
+{
+  long long buf[s->elem_size / sizeof(long long)]; // elem_size 는 8 의 배수
+  slot_job_t *elem = (slot_job_t *)buf;
+
+  elem->enq_ns = now_ns();
+  memcpy(elem->job, job, s->job_size);
+  return ring_push(&s->ring, elem);
+}
+
+int sched_nworkers(sched_t *s)
+{
+  return atomic_load(&s->nlive);
+}
+
+/* 과부하 제어 켜기. worker 가 작업을 꺼내기 전에 호출할 것 (sched_create 직후) */
+void sched_set_shed(sched_t *s, sched_handler_t shed, int target_ms, int interval_ms)
+{
+  codel_t *cd = &s->codel;
+
+  pthread_mutex_init(&cd->lock, NULL);
+  cd->target_ns = target_ms * 1000000LL;
+  cd->interval_ns = interval_ms * 1000000LL;
+  atomic_init(&cd->first_above, 0);
+  atomic_init(&cd->dropping, 0);
+  cd->drop_next = 0;
+  cd->count = 0;
+  s->shed = shed;
+}
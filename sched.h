@@ -0,0 +1,51 @@
+/*
+    sched.h - worker thread pool 과 work-stealing scheduler
+
+    전역 큐 하나를 mutex + condition variable 로 나눠 쓰던 방식 대신
+    lock-free MPMC ring (ring.c) 으로 작업을 넘겨받고, worker 마다 Chase-Lev deque 를 하나씩 가짐.
+
+    - 작업 제출 : 작업(job_size 바이트 값)을 ring 에 복사 (lock, malloc 없음)
+    - 작업 수행 : worker 는 자기 deque bottom 에서 pop
+                  -> 비었으면 ring 에서 CAS 한 번으로 여러 개를 꺼내 하나는 바로 처리, 나머지는 자기 deque 에 (batch)
+                  -> ring 도 비었으면 다른 worker 의 deque top 에서 훔침
+                  -> 훔칠 것도 없으면 ring 의 futex 에서 잠듦
+*/
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdatomic.h>
+#include "ring.h"
+
+/* Chase-Lev 작업 deque. owner thread 만 push/take, 다른 thread 는 steal */
+typedef struct
+{
+  atomic_long size; // 원형 배열 크기 (2의 거듭제곱)
+  _Atomic(void *) slots[];
+} deque_array_t;
+
+typedef struct
+{
+  atomic_long top;    // steal 하는 쪽 (FIFO)
+  atomic_long bottom; // owner 가 push/take 하는 쪽 (LIFO)
+  _Atomic(deque_array_t *) array;
+} deque_t;
+
+void deque_init(deque_t *dq);
+void deque_push(deque_t *dq, void *job);
+void *deque_take(deque_t *dq);
+void *deque_steal(deque_t *dq);
+
+typedef struct sched sched_t;
+
+/* 작업 처리 함수. worker thread 에서 job 하나마다 호출됨. job 은 호출이 끝나면 scheduler 가 재사용/해제 */
+typedef void (*sched_handler_t)(void *job);
+
+/* worker 는 min_workers 개로 시작해서 밀리면 max_workers 까지 늘고, 오래 놀면 다시 min_workers 까지 줄어듦 */
+sched_t *sched_create(int min_workers, int max_workers, size_t job_size, sched_handler_t handler);
+int sched_submit(sched_t *s, const void *job); // job 을 복사해서 제출. ring 이 가득 찼으면 -1
+int sched_nworkers(sched_t *s);                 // 지금 살아있는 worker 수
+
+/* CoDel 과부하 제어. 대기 시간이 interval_ms 동안 계속 target_ms 를 넘으면 일부 작업을 handler 대신 shed 로 넘김 */
+void sched_set_shed(sched_t *s, sched_handler_t shed, int target_ms, int interval_ms);
+
+#endif /* __SCHED_H__ */
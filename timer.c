@@ -0,0 +1,118 @@
+/*
+    timer.c - hashed timing wheel
+*/
+#include <time.h>
+#include "timer.h"
+
+long long tw_now_ms(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void list_unlink(tw_timer_t *t)
+{
+  t->prev->next = t->next;
+  t->next->prev = t->prev;
+  t->prev = t->next = t;
+}
+
+static void list_append(tw_timer_t *head, tw_timer_t *t)
+{
+  t->prev = head->prev;
+  t->next = head;
+  head->prev->next = t;
+  head->prev = t;
+}
+
+void tw_init(timer_wheel_t *w, long long tick_ms)
+{
+  for (int i = 0; i < TW_SLOTS; i++)
+    w->slots[i].prev = w->slots[i].next = &w->slots[i];
+  w->tick_ms = tick_ms;
+  w->cur_tick = tw_now_ms() / tick_ms;
+  w->count = 0;
+}
+
+void tw_timer_init(tw_timer_t *t, tw_callback_t cb, void *arg)
+{
+  t->prev = t->next = t;
+  t->expire_ms = 0;
+  t->cb = cb;
+  t->arg = arg;
+  t->pending = 0;
+}
+
+void tw_add(timer_wheel_t *w, tw_timer_t *t, long long expire_ms)
+{
+  /* 만료 시각이 속한 tick 을 올림으로 계산. 이미 지난 tick 이면 바로 다음 tick 에 실행 */
+  long long tick = (expire_ms + w->tick_ms - 1) / w->tick_ms;
+
+  tw_del(w, t);
+  if (tick <= w->cur_tick)
+    tick = w->cur_tick + 1;
+  t->expire_ms = expire_ms;
+  t->pending = 1;
+  list_append(&w->slots[tick & (TW_SLOTS - 1)], t);
+  w->count++;
+}
+
+void tw_del(timer_wheel_t *w, tw_timer_t *t)
+{
+  if (!t->pending)
+    return;
+  list_unlink(t);
+  t->pending = 0;
+  w->count--;
+}
+
+/* cur_tick 다음부터 now 가 속한 tick 까지 slot 을 차례로 처리.
+   callback 안에서 timer 를 추가/삭제해도 되도록, slot 머리에서 하나씩 떼어내며 처리하고
+   아직 시각이 안 된 (다음 바퀴) timer 는 따로 모았다가 되돌려 놓음 */
+int tw_advance(timer_wheel_t *w, long long now_ms)
+{
+  long long now_tick = now_ms / w->tick_ms;
+  long long end = now_tick;
+  int fired = 0;
+
+  if (end - w->cur_tick > TW_SLOTS) // 한 바퀴 넘게 밀렸으면 모든 slot 을 한 번씩만 보면 됨
+    w->cur_tick = end - TW_SLOTS;
+
+  while (w->cur_tick < end)
+  {
+    tw_timer_t *head = &w->slots[++w->cur_tick & (TW_SLOTS - 1)];
+    tw_timer_t keep;
+    keep.prev = keep.next = &keep;
+
+    while (head->next != head)
+    {
+      tw_timer_t *t = head->next;
+      list_unlink(t);
+      if (t->expire_ms > now_ms)
+      {
+        list_append(&keep, t);
+        continue;
+      }
+      t->pending = 0;
+      w->count--;
+      t->cb(t, t->arg);
+      fired++;
+    }
+
+    /* 남겨둔 timer 들을 slot 으로 되돌림 */
+    while (keep.next != &keep)
+    {
+      tw_timer_t *t = keep.next;
+      list_unlink(t);
+      list_append(head, t);
+    }
+  }
+  return fired;
+}
+
+/* 정확한 다음 만료 시각을 찾으려면 slot 을 훑어야 하므로, timer 가 있으면 tick 마다 깨어나는 것으로 충분 */
+int tw_next_timeout(timer_wheel_t *w)
+{
+  return w->count > 0 ? (int)w->tick_ms : -1;
+}
@@ -0,0 +1,45 @@
+/*
+    timer.h - hashed timing wheel
+
+    slot 이 TW_SLOTS 개인 원형 배열. 만료 시각을 tick 단위로 나눈 값으로 slot 을 고르고,
+    한 바퀴보다 먼 timer 는 같은 slot 에 두었다가 시각이 지났을 때만 실행함.
+    추가/삭제 O(1), 만료 처리는 지나간 tick 의 slot 만 확인.
+
+    timer 구조체는 사용하는 쪽 구조체에 넣어 두는 방식 (malloc 없음).
+    한 thread 에서만 쓰는 구조 (event loop 하나당 wheel 하나). lock 없음.
+*/
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#define TW_SLOTS 1024 // 2의 거듭제곱
+
+typedef struct tw_timer tw_timer_t;
+typedef void (*tw_callback_t)(tw_timer_t *t, void *arg);
+
+struct tw_timer
+{
+  tw_timer_t *prev, *next;
+  long long expire_ms; // 만료 시각 (tw_now_ms 기준)
+  tw_callback_t cb;
+  void *arg;
+  int pending; // wheel 에 들어있는지
+};
+
+typedef struct
+{
+  tw_timer_t slots[TW_SLOTS]; // slot 마다 원형 이중 연결 리스트의 머리 (sentinel)
+  long long tick_ms;
+  long long cur_tick; // 여기까지의 tick 은 처리 끝
+  int count;          // 들어있는 timer 수
+} timer_wheel_t;
+
+long long tw_now_ms(void); // CLOCK_MONOTONIC 밀리초
+
+void tw_init(timer_wheel_t *w, long long tick_ms);
+void tw_timer_init(tw_timer_t *t, tw_callback_t cb, void *arg);
+void tw_add(timer_wheel_t *w, tw_timer_t *t, long long expire_ms); // 이미 들어있으면 다시 걸음
+void tw_del(timer_wheel_t *w, tw_timer_t *t);                      // 들어있지 않으면 아무 일 없음
+int tw_advance(timer_wheel_t *w, long long now_ms);                // 만료된 timer 실행, 실행한 개수 반환
+int tw_next_timeout(timer_wheel_t *w);                             // epoll_wait 에 넘길 timeout (ms), timer 가 없으면 -1
+
+#endif /* __TIMER_H__ */
@@ -9,9 +9,10 @@
 #include "csapp.h"
 
 void doit(int fd);
-void read_requesthdrs(rio_t *rp);
+void read_requesthdrs(rio_t *rp, time_t *since);
+time_t parse_http_date(char *s);
 int parse_uri(char *uri, char *filename, char *cgiargs);
-void serve_static(int fd, char *filename, int filesize, int method_flag);
+void serve_static(int fd, char *filename, int filesize, time_t mtime, time_t since, int method_flag);
 void get_filetype(char *filename, char *filetype);
 void serve_dynamic(int fd, char *filename, char *cgiargs, int method_flag);
 void clienterror(int fd, char *cause, char *errnum, char *shortmsg,
@@ -67,6 +68,7 @@ void doit(int fd)
     이 정보를 기반으로 요청 처리 진행. */
   int is_static;
   int method_flag; // Homework 11.11, 0(GET), 1(HEAD)
+  time_t since = -1; // If-Modified-Since, 없으면 -1
   struct stat sbuf; // struct stat 구조체는 파일의 메타데이터에 대한 정보를 저장.
   char buf[MAXLINE], method[MAXLINE], uri[MAXLINE], version[MAXLINE];
   char filename[MAXLINE], cgiargs[MAXLINE];
@@ -85,7 +87,7 @@ void doit(int fd)
             "Tiny does not implement this method");
     return;
   }
-  read_requesthdrs(&rio); // 요청 메세지(Request Line)의 헤더 정보를 읽어옴.
+  read_requesthdrs(&rio, &since); // 요청 메세지(Request Line)의 헤더 정보를 읽어옴.
 
   /* GET인지 HEAD인지 확인 */
   if (strcasecmp(method, "GET") == 0)
@@ -111,7 +113,7 @@ void doit(int fd)
                   "Tiny couldn't read the file");
       return;
     }
-    serve_static(fd, filename, sbuf.st_size, method_flag); // 정적파일 클라이언트로 전송
+    serve_static(fd, filename, sbuf.st_size, sbuf.st_mtime, since, method_flag); // 정적파일 클라이언트로 전송
   }
   else { /* Serve dynamic content */
     if (!(S_ISREG(sbuf.st_mode)) || !(S_IXUSR & sbuf.st_mode)) {
@@ -158,8 +160,9 @@ void clienterror(int fd, char *cause, char *errnum,
 
 /* client로 부터 수신된 요청 메세지의 헤더를 읽어들이는 함수 
   read request headers
-  request에 대한 처리 방법 결정 */
-void read_requesthdrs(rio_t *rp)
+  request에 대한 처리 방법 결정
+  If-Modified-Since 헤더가 있으면 그 시각을 since 에 저장 (조건부 요청) */
+void read_requesthdrs(rio_t *rp, time_t *since)
 {
   char buf[MAXLINE];
 
@@ -168,6 +171,8 @@ void read_requesthdrs(rio_t *rp)
   Rio_readlineb(rp, buf, MAXLINE); // 요청 메세지의 첫 번째 헤어 읽음
   while (strcmp(buf, "\r\n"))
   {
+    if (!strncasecmp(buf, "If-Modified-Since:", 18))
+      *since = parse_http_date(buf + 18);
     // 빈줄이 나올때까지 한줄 한줄 헤더를 읽음
     Rio_readlineb(rp, buf, MAXLINE);
     printf("%s", buf);
@@ -175,6 +180,24 @@ void read_requesthdrs(rio_t *rp)
   return;
 }
 
+/* HTTP 날짜 (예: Sun, 06 Nov 1994 08:49:37 GMT) 를 time_t 로 바꾸는 함수. 잘못된 값이면 -1 */
+time_t parse_http_date(char *s)
+{
+  static const char *months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+  struct tm tm;
+  char mon[4], *p;
+
+  memset(&tm, 0, sizeof(tm));
+  if (sscanf(s, " %*[a-zA-Z], %d %3s %d %d:%d:%d GMT", &tm.tm_mday, mon, &tm.tm_year,
+             &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+    return -1;
+  if ((p = strstr(months, mon)) == NULL || (p - months) % 3)
+    return -1;
+  tm.tm_mon = (p - months) / 3;
+  tm.tm_year -= 1900;
+  return timegm(&tm);
+}
+
 /* uri를 분석하는 함수로 
   파일명(filename 포인터)과 CGI 인자(cgiargs 포인터)를 추출하는 함수 */
 int parse_uri(char *uri, char *filename, char *cgiargs)
@@ -218,16 +241,32 @@ int parse_uri(char *uri, char *filename, char *cgiargs)
 }
 
 /* 정적 콘텐츠(HTML, 이미지 등)을 처리하여 클라이언트에게 응답을 보내는 함수 */
-void serve_static(int fd, char *filename, int filesize, int method_flag)
+void serve_static(int fd, char *filename, int filesize, time_t mtime, time_t since, int method_flag)
 {
   int srcfd;
-  char *srcp, filetype[MAXLINE], buf[MAXBUF];
+  char *srcp, filetype[MAXLINE], buf[MAXBUF], lastmod[64];
+
+  // 파일의 마지막 수정 시각. 캐시는 이것을 If-Modified-Since 로 다시 보내서 바뀌었는지 물어봄
+  strftime(lastmod, sizeof(lastmod), "%a, %d %b %Y %H:%M:%S GMT", gmtime(&mtime));
+
+  /* 요청한 쪽이 가진 것 이후로 파일이 바뀌지 않았으면 본문 없이 304 */
+  if (since != -1 && mtime <= since) {
+    sprintf(buf, "HTTP/1.0 304 Not Modified\r\n"
+                 "Server: Tiny Web Server\r\n"
+                 "Connection: close\r\n"
+                 "Last-Modified: %s\r\n\r\n", lastmod);
+    Rio_writen(fd, buf, strlen(buf));
+    printf("Response headers:\n");
+    printf("%s", buf);
+    return;
+  }
 
   /* Send response headers to client */
   get_filetype(filename, filetype); // file type을 가져옴
   sprintf(buf, "HTTP/1.0 200 OK\r\n"); // 클라이언트 요청이 성공적으로 처리됨.
   sprintf(buf, "%sServer: Tiny Web Server\r\n", buf); 
   sprintf(buf, "%sConnection: close\r\n", buf);
+  sprintf(buf, "%sLast-Modified: %s\r\n", buf, lastmod);
   sprintf(buf, "%sContent-length: %d\r\n", buf, filesize);
   sprintf(buf, "%sContent-type: %s\r\n\r\n", buf, filetype);
 
@@ -0,0 +1,94 @@
+/*
+    tinylfu.c - TinyLFU 접근 빈도 추정 (count-min sketch + doorkeeper)
+*/
+#include <stdlib.h>
+#include <string.h>
+#include "tinylfu.h"
+#include "csapp.h"
+
+/* 행마다 hash 를 다르게 섞는 곱셈 상수 (홀수). 캐시는 hash 의 하위 / 상위 bit 를 shard 와 index 에 이미 쓰므로
+   그대로 잘라 쓰지 않고 곱해서 섞은 상위 bit 를 씀 */
+static const uint64_t seeds[TINYLFU_ROWS + 2] = {
+    0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL,
+    0xd6e8feb86659fd93ULL, 0xff51afd7ed558ccdULL, 0xc4ceb9fe1a85ec53ULL};
+
+static inline size_t mix(uint64_t hash, int i, size_t n)
+{
+  uint64_t x = hash * seeds[i];
+  return ((x ^ (x >> 29)) >> 7) & (n - 1);
+}
+
+static inline int counter_get(tinylfu_t *t, size_t i)
+{
+  return (t->counters[i >> 4] >> ((i & 15) * 4)) & 0xf;
+}
+
+static inline void counter_inc(tinylfu_t *t, size_t i)
+{
+  if (counter_get(t, i) < TINYLFU_MAX)
+    t->counters[i >> 4] += 1ULL << ((i & 15) * 4);
+}
+
+void tinylfu_init(tinylfu_t *t, size_t capacity)
+{
+  t->width = 16;
+  while (t->width < capacity)
+    t->width <<= 1;
+  t->door_bits = t->width * 4;
+  t->counters = Calloc(t->width * TINYLFU_ROWS / 16, sizeof(uint64_t));
+  t->door = Calloc(t->door_bits / 64, sizeof(uint64_t));
+  t->additions = 0;
+  t->sample = t->width * 10;
+}
+
+void tinylfu_free(tinylfu_t *t)
+{
+  free(t->counters);
+  free(t->door);
+}
+
+/* doorkeeper 에 있는지 (hash 두 개짜리 Bloom filter). set 이면 없을 때 표시도 함 */
+static int door_contains(tinylfu_t *t, uint64_t hash, int set)
+{
+  size_t a = mix(hash, TINYLFU_ROWS, t->door_bits), b = mix(hash, TINYLFU_ROWS + 1, t->door_bits);
+  int found = (t->door[a >> 6] >> (a & 63) & 1) && (t->door[b >> 6] >> (b & 63) & 1);
+
+  if (!found && set)
+  {
+    t->door[a >> 6] |= 1ULL << (a & 63);
+    t->door[b >> 6] |= 1ULL << (b & 63);
+  }
+  return found;
+}
+
+/* 모든 카운터를 반으로 (nibble 마다 오른쪽으로 1 bit, 옆 nibble 에서 넘어온 bit 는 지움) */
+static void age(tinylfu_t *t)
+{
+  for (size_t i = 0; i < t->width * TINYLFU_ROWS / 16; i++)
+    t->counters[i] = (t->counters[i] >> 1) & 0x7777777777777777ULL;
+  memset(t->door, 0, t->door_bits / 8);
+  t->additions /= 2;
+}
+
+void tinylfu_record(tinylfu_t *t, uint64_t hash)
+{
+  if (++t->additions >= t->sample)
+    age(t);
+  if (!door_contains(t, hash, 1)) // 처음 봄. doorkeeper 에만 표시
+    return;
+  for (int i = 0; i < TINYLFU_ROWS; i++)
+    counter_inc(t, i * t->width + mix(hash, i, t->width));
+}
+
+int tinylfu_estimate(tinylfu_t *t, uint64_t hash)
+{
+  int min = TINYLFU_MAX;
+
+  for (int i = 0; i < TINYLFU_ROWS; i++)
+  {
+    int c = counter_get(t, i * t->width + mix(hash, i, t->width));
+    if (c < min)
+      min = c;
+  }
+  return min + door_contains(t, hash, 0);
+}
@@ -0,0 +1,40 @@
+/*
+    tinylfu.h - TinyLFU 접근 빈도 추정 (count-min sketch + doorkeeper)
+
+    key 를 저장하지 않고 64 bit hash 만으로 "최근에 얼마나 자주 요청되었나" 를 근사함.
+    - doorkeeper : Bloom filter. 처음 보는 key 는 여기에만 표시하고 두 번째부터 sketch 에 셈.
+                   한 번 요청되고 마는 key (crawler 등) 가 sketch 카운터를 채우지 않도록
+    - sketch     : 4 행짜리 count-min sketch. 카운터는 4 bit (최대 15) 라서 16 개가 uint64 하나에 들어감.
+                   행마다 다르게 섞은 hash 로 카운터 하나씩을 고르고, 그중 가장 작은 값이 추정치
+    - aging      : 기록 횟수가 sample 에 이르면 모든 카운터를 반으로 줄이고 doorkeeper 를 비움.
+                   예전에만 인기 있던 key 가 계속 높은 빈도로 남지 않도록
+
+    thread 안전하지 않음 (호출하는 쪽에서 보호).
+*/
+#ifndef __TINYLFU_H__
+#define __TINYLFU_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TINYLFU_ROWS 4
+#define TINYLFU_MAX 15 // 4 bit 카운터의 최댓값
+
+typedef struct
+{
+  uint64_t *counters; // 4 bit 카운터. 행 하나가 width 개
+  size_t width;       // 행 하나의 카운터 수 (2의 거듭제곱)
+  uint64_t *door;     // doorkeeper bit
+  size_t door_bits;   // doorkeeper bit 수 (2의 거듭제곱)
+  size_t additions;   // 마지막 aging 뒤로 기록한 횟수
+  size_t sample;      // aging 주기
+} tinylfu_t;
+
+/* capacity: 기억해 둘 key 수의 어림값. 카운터 수와 aging 주기 (capacity 의 10 배) 를 정함 */
+void tinylfu_init(tinylfu_t *t, size_t capacity);
+void tinylfu_free(tinylfu_t *t);
+
+void tinylfu_record(tinylfu_t *t, uint64_t hash);   // 요청 한 번
+int tinylfu_estimate(tinylfu_t *t, uint64_t hash);  // 추정 빈도 (0 ~ TINYLFU_MAX + 1)
+
+#endif /* __TINYLFU_H__ */
@@ -0,0 +1,205 @@
+/*
+    upstream.c - 웹 서버(origin) 연결과 origin 별 timeout
+*/
+#include <poll.h>
+#include "upstream.h"
+#include "timer.h"
+
+typedef struct
+{
+  char hostname[MAXLINE];
+  int port;
+  upstream_timeouts_t t;
+} origin_conf_t;
+
+static upstream_timeouts_t default_timeouts = {UPSTREAM_CONNECT_TIMEOUT, UPSTREAM_FIRSTBYTE_TIMEOUT,
+                                               UPSTREAM_IDLE_TIMEOUT};
+static origin_conf_t origins[UPSTREAM_MAX_ORIGINS];
+static int norigins = 0;
+
+static int parse_timeouts(const char *spec, upstream_timeouts_t *t)
+{
+  if (sscanf(spec, "%d:%d:%d", &t->connect_ms, &t->firstbyte_ms, &t->idle_ms) != 3)
+    return -1;
+  if (t->connect_ms < 0 || t->firstbyte_ms < 0 || t->idle_ms < 0)
+    return -1;
+  return 0;
+}
+
+int upstream_set_default(const char *spec)
+{
+  return parse_timeouts(spec, &default_timeouts);
+}
+
+int upstream_add_origin(const char *spec)
+{
+  origin_conf_t *o = &origins[norigins];
+  const char *eq = strchr(spec, '=');
+
+  if (norigins == UPSTREAM_MAX_ORIGINS || eq == NULL || eq - spec >= MAXLINE)
+    return -1;
+  if (sscanf(spec, "%[^:=]:%d=", o->hostname, &o->port) != 2 || parse_timeouts(eq + 1, &o->t) < 0)
+    return -1;
+  norigins++;
+  return 0;
+}
+
+void upstream_timeouts(char *hostname, int port, upstream_timeouts_t *t)
+{
+  for (int i = 0; i < norigins; i++)
+  {
+    if (origins[i].port == port && !strcasecmp(origins[i].hostname, hostname))
+    {
+      *t = origins[i].t;
+      return;
+    }
+  }
+  *t = default_timeouts;
+}
+
+/* 주소 조회 대기열. resolver thread 들이 FIFO 로 꺼내 감 */
+static pthread_mutex_t resolve_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t resolve_cond = PTHREAD_COND_INITIALIZER;
+static upstream_resolve_t *resolve_head, *resolve_tail;
+static pthread_once_t resolve_once = PTHREAD_ONCE_INIT;
+
+static void *resolve_thread(void *arg)
+{
+  struct addrinfo hints;
+  upstream_resolve_t *r;
+
+  Pthread_detach(pthread_self());
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  while (1)
+  {
+    pthread_mutex_lock(&resolve_lock);
+    while (resolve_head == NULL)
+      pthread_cond_wait(&resolve_cond, &resolve_lock);
+    r = resolve_head;
+    if ((resolve_head = r->next) == NULL)
+      resolve_tail = NULL;
+    pthread_mutex_unlock(&resolve_lock);
+
+    if ((r->rc = getaddrinfo(r->hostname, r->port, &hints, &r->addrs)) != 0)
+      r->addrs = NULL;
+    free(r->hostname);
+    r->hostname = NULL;
+    atomic_store_explicit(&r->done, 1, memory_order_release);
+    r->complete(r);
+  }
+  return NULL;
+}
+
+static void resolve_init(void)
+{
+  pthread_t tid;
+
+  for (int i = 0; i < UPSTREAM_RESOLVERS; i++)
+    Pthread_create(&tid, NULL, resolve_thread, NULL);
+}
+
+void upstream_resolve_start(upstream_resolve_t *r, const char *hostname, int port)
+{
+  pthread_once(&resolve_once, resolve_init);
+  r->hostname = strdup(hostname);
+  snprintf(r->port, sizeof(r->port), "%d", port);
+  r->rc = 0;
+  r->addrs = NULL;
+  atomic_init(&r->done, 0);
+  r->next = NULL;
+
+  pthread_mutex_lock(&resolve_lock);
+  if (resolve_tail != NULL)
+    resolve_tail->next = r;
+  else
+    resolve_head = r;
+  resolve_tail = r;
+  pthread_cond_signal(&resolve_cond);
+  pthread_mutex_unlock(&resolve_lock);
+}
+
+int upstream_connect_start(struct addrinfo *p)
+{
+  int fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol);
+
+  if (fd < 0)
+    return -1;
+  if (connect(fd, p->ai_addr, p->ai_addrlen) == 0 || errno == EINPROGRESS)
+    return fd;
+  close(fd);
+  return -1;
+}
+
+int upstream_wait_readable(int fd, int ms)
+{
+  struct pollfd pfd = {fd, POLLIN, 0};
+  int rc;
+
+  while ((rc = poll(&pfd, 1, ms > 0 ? ms : -1)) < 0 && errno == EINTR)
+    ;
+  return rc != 0; // 에러도 읽기 시도에서 드러나도록 1 로 돌려줌
+}
+
+/* non-blocking connect 를 걸고 deadline 까지 쓰기 가능해지기를 기다림. 0 성공, -1 실패, -3 timeout */
+static int connect_until(int fd, struct addrinfo *p, long long deadline)
+{
+  struct pollfd pfd = {fd, POLLOUT, 0};
+  int err = 0, rc;
+  socklen_t len = sizeof(err);
+
+  if (connect(fd, p->ai_addr, p->ai_addrlen) == 0)
+    return 0;
+  if (errno != EINPROGRESS)
+    return -1;
+
+  do
+  {
+    long long left = deadline ? deadline - tw_now_ms() : -1;
+    if (deadline && left <= 0)
+      return -3;
+    rc = poll(&pfd, 1, (int)left);
+  } while ((rc < 0 && errno == EINTR) || rc == 0);
+  if (rc < 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0 || err != 0)
+    return -1;
+  return 0;
+}
+
+int upstream_connect(char *hostname, int port, const upstream_timeouts_t *t)
+{
+  char port_str[16];
+  struct addrinfo hints, *listp, *p;
+  long long deadline = t->connect_ms ? tw_now_ms() + t->connect_ms : 0;
+  int fd = -1, rc = -1;
+
+  sprintf(port_str, "%d", port);
+  memset(&hints, 0, sizeof(struct addrinfo));
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICSERV | AI_ADDRCONFIG;
+  if ((rc = getaddrinfo(hostname, port_str, &hints, &listp)) != 0)
+  {
+    fprintf(stderr, "getaddrinfo failed (%s:%s): %s\n", hostname, port_str, gai_strerror(rc));
+    return -2;
+  }
+
+  /* 주소 목록 전체가 connect timeout 하나를 나눠 씀 */
+  for (p = listp; p; p = p->ai_next)
+  {
+    if ((fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol)) < 0)
+      continue;
+    if ((rc = connect_until(fd, p, deadline)) == 0)
+      break;
+    close(fd);
+    fd = -1;
+    if (rc == -3)
+      break;
+  }
+  freeaddrinfo(listp);
+  if (fd < 0)
+    return rc == -3 ? -3 : -1;
+
+  /* Rio 는 blocking socket 을 가정하므로 되돌려 놓음 */
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+  return fd;
+}
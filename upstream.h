@@ -0,0 +1,65 @@
+/*
+    upstream.h - 웹 서버(origin) 연결과 origin 별 timeout
+
+    Open_clientfd 는 주소마다 blocking connect 를 하므로 죽은 웹 서버 하나가
+    커널 SYN timeout (수십 초) 동안 worker 를 붙잡음. 여기서는 connect 를 non-blocking 으로 걸고
+    origin 마다 정한 시간 안에 끝나지 않으면 포기함.
+
+    timeout 세 가지 (밀리초, 0 이면 제한 없음)
+      connect   : TCP 연결이 맺어질 때까지
+      firstbyte : 요청을 보낸 뒤 응답 첫 바이트가 올 때까지
+      idle      : 응답 도중 다음 데이터가 올 때까지
+
+    getaddrinfo 는 blocking 이라 event loop 는 주소 조회를 resolver thread (UPSTREAM_RESOLVERS 개) 에 맡기고
+    끝났다는 알림만 받음. DNS 가 느려도 그 연결만 기다리고 loop 의 다른 연결은 계속 진행됨.
+*/
+#ifndef __UPSTREAM_H__
+#define __UPSTREAM_H__
+
+#include <stdatomic.h>
+#include "csapp.h"
+
+#define UPSTREAM_CONNECT_TIMEOUT 3000
+#define UPSTREAM_FIRSTBYTE_TIMEOUT 10000
+#define UPSTREAM_IDLE_TIMEOUT 10000
+#define UPSTREAM_MAX_ORIGINS 64
+#define UPSTREAM_RESOLVERS 4 // event loop 대신 getaddrinfo 를 부르는 thread 수
+
+typedef struct
+{
+  int connect_ms;
+  int firstbyte_ms;
+  int idle_ms;
+} upstream_timeouts_t;
+
+/* 설정. main 에서 worker 를 만들기 전에만 호출 (이후에는 읽기만 하므로 lock 없음) */
+int upstream_set_default(const char *spec);            // "connect:firstbyte:idle"
+int upstream_add_origin(const char *spec);             // "host:port=connect:firstbyte:idle"
+void upstream_timeouts(char *hostname, int port, upstream_timeouts_t *t);
+
+/* resolver thread 에 맡긴 주소 조회 하나 */
+typedef struct upstream_resolve
+{
+  char *hostname;
+  char port[16];
+  int rc;                 // getaddrinfo 반환값 (0 이면 성공)
+  struct addrinfo *addrs; // 찾은 주소 목록. 받은 쪽이 freeaddrinfo
+  atomic_int done;        // 조회가 끝나서 rc, addrs 를 읽어도 됨
+  void (*complete)(struct upstream_resolve *r); // 끝나면 resolver thread 에서 호출. 이 뒤로 resolver 는 r 을 건드리지 않음
+  struct upstream_resolve *next;
+} upstream_resolve_t;
+
+/* event loop 용. hostname:port 의 주소 조회를 resolver thread 에 맡김. r->complete 는 미리 채워 둘 것 */
+void upstream_resolve_start(upstream_resolve_t *r, const char *hostname, int port);
+
+/* event loop 용. non-blocking socket 을 만들어 connect 를 시작만 함. 실패하면 -1 */
+int upstream_connect_start(struct addrinfo *p);
+
+/* thread pool 용. 주소마다 connect timeout 안에 연결되는지 기다림.
+   -1 연결 실패, -2 주소 조회 실패, -3 timeout. 성공하면 blocking socket 을 반환 */
+int upstream_connect(char *hostname, int port, const upstream_timeouts_t *t);
+
+/* fd 에 읽을 데이터가 올 때까지 최대 ms 기다림. 1 이면 읽을 수 있음, 0 이면 timeout */
+int upstream_wait_readable(int fd, int ms);
+
+#endif /* __UPSTREAM_H__ */